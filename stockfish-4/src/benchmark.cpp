@@ -17,13 +17,32 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <istream>
+#include <sstream>
 #include <vector>
 
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <signal.h>
+#  include <spawn.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+extern char** environ;
+#endif
+
+#include "evaluate.h"
 #include "misc.h"
+#include "movegen.h"
+#include "notation.h"
 #include "position.h"
+#include "rkiss.h"
 #include "search.h"
 #include "thread.h"
 #include "tt.h"
@@ -51,13 +70,33 @@ static const char* Defaults[] = {
 };
 
 
+static string int_to_string(int n) {
+
+  ostringstream ss;
+  ss << n;
+  return ss.str();
+}
+
+
+// set_hash_mb() sets the size of the transposition table in MB. As "Hash KB",
+// when not zero, overrides "Hash", it is cleared after "Hash" has been set,
+// so that the table is resized only once.
+
+static void set_hash_mb(const string& mb) {
+
+  Options["Hash"] = mb;
+  Options["Hash KB"] = string("0");
+}
+
+
 /// benchmark() runs a simple benchmark by letting Stockfish analyze a set
 /// of positions for a given limit each. There are five parameters; the
-/// transposition table size, the number of search threads that should
+/// transposition table size in MB, or "current" to keep it, the number of search threads that should
 /// be used, the limit value spent for each position (optional, default is
 /// depth 12), an optional file name where to look for positions in fen
 /// format (defaults are the positions defined above) and the type of the
-/// limit value: depth (default), time in secs or number of nodes.
+/// limit value: depth (default), time in secs, number of nodes, or perft depth,
+/// with "divide" printing the count of each root move too.
 
 void benchmark(const Position& current, istream& is) {
 
@@ -72,7 +111,9 @@ void benchmark(const Position& current, istream& is) {
   string fenFile   = (is >> token) ? token : "default";
   string limitType = (is >> token) ? token : "depth";
 
-  Options["Hash"]    = ttSize;
+  if (ttSize != "current")
+      set_hash_mb(ttSize);
+
   Options["Threads"] = threads;
   TT.clear();
 
@@ -116,15 +157,25 @@ void benchmark(const Position& current, istream& is) {
   Search::StateStackPtr st;
   Time::point elapsed = Time::now();
 
+  for (size_t i = 0; i < Threads.size(); i++)
+  {
+      Threads[i]->pawnsTable.probes = Threads[i]->pawnsTable.hits
+                                    = Threads[i]->pawnsTable.sharedHits = 0;
+      Threads[i]->evalTable.probes = Threads[i]->evalTable.hits = 0;
+      Threads[i]->splits = Threads[i]->failedBookings
+                         = Threads[i]->lockWaits = Threads[i]->lockWaitTime = 0;
+      std::memset(Threads[i]->wakeups, 0, sizeof(Threads[i]->wakeups));
+  }
+
   for (size_t i = 0; i < fens.size(); i++)
   {
       Position pos(fens[i], Options["UCI_Chess960"], Threads.main());
 
       cerr << "\nPosition: " << i + 1 << '/' << fens.size() << endl;
 
-      if (limitType == "perft")
+      if (limitType == "perft" || limitType == "divide")
       {
-          size_t cnt = Search::perft(pos, limits.depth * ONE_PLY);
+          size_t cnt = Search::perft(pos, limits.depth * ONE_PLY, limitType == "divide");
           cerr << "\nPerft " << limits.depth  << " leaf nodes: " << cnt << endl;
           nodes += cnt;
       }
@@ -132,14 +183,764 @@ void benchmark(const Position& current, istream& is) {
       {
           Threads.start_thinking(pos, limits, vector<Move>(), st);
           Threads.wait_for_think_finished();
-          nodes += Search::RootPos.nodes_searched();
+          nodes += Search::nodes_searched();
       }
   }
 
   elapsed = Time::now() - elapsed + 1; // Assure positive to avoid a 'divide by zero'
 
+  uint64_t probes = 1, hits = 0, sharedHits = 0, evalProbes = 1, evalHits = 0;
+  uint64_t splits = 0, failedBookings = 0, lockWaits = 0, lockWaitTime = 0;
+  uint64_t wakeups[WAKEUP_BUCKETS] = {};
+
+  for (size_t i = 0; i < Threads.size(); i++)
+  {
+      probes += Threads[i]->pawnsTable.probes;
+      hits += Threads[i]->pawnsTable.hits;
+      sharedHits += Threads[i]->pawnsTable.sharedHits;
+      evalProbes += Threads[i]->evalTable.probes;
+      evalHits += Threads[i]->evalTable.hits;
+      splits += Threads[i]->splits;
+      failedBookings += Threads[i]->failedBookings;
+      lockWaits += Threads[i]->lockWaits;
+      lockWaitTime += Threads[i]->lockWaitTime;
+
+      for (int b = 0; b < WAKEUP_BUCKETS; b++)
+          wakeups[b] += Threads[i]->wakeups[b];
+  }
+
   cerr << "\n==========================="
        << "\nTotal time (ms) : " << elapsed
        << "\nNodes searched  : " << nodes
-       << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+       << "\nNodes/second    : " << 1000 * nodes / elapsed
+       << "\nPawn hash hits  : " << 100 * hits / probes << "% thread, "
+                                 << 100 * sharedHits / probes << "% shared"
+       << "\nEval cache hits : " << 100 * evalHits / evalProbes << "%"
+       << "\nSplits          : " << splits << ", " << failedBookings << " failed bookings"
+       << "\nLock waits      : " << lockWaits << ", " << lockWaitTime / 1000 << " ms" << endl;
+
+  // Histogram of the time from booking to search start of the slaves, in usec
+  if (splits)
+  {
+      cerr << "Slave wakeup    :";
+
+      for (int b = 0; b < WAKEUP_BUCKETS; b++)
+          if (wakeups[b])
+              cerr << (b < WAKEUP_BUCKETS - 1 ? " <" : " >=")
+                   << (1LL << std::min(b, WAKEUP_BUCKETS - 2)) << "us " << wakeups[b];
+
+      cerr << endl;
+  }
+}
+
+
+namespace {
+
+  // The TT stress test keeps a shared pool of keys and each worker randomly
+  // stores and probes them, with the data of every entry being a function of
+  // its key. A probe hit returning data that doesn't belong to the key is a
+  // torn entry that escaped the XOR verification.
+
+  const int StressKeys = 1 << 18;
+  vector<Key> StressPool;
+
+  struct StressCounters {
+    int64_t ops, stores, hits, corrupted;
+  };
+
+  Move   stress_move(Key k)  { return Move(((k >> 12) & 0xFFF) | 1); }
+  Value  stress_value(Key k) { return Value(int((k >> 24) & 0x3FFF) - 0x2000); }
+  Depth  stress_depth(Key k) { return Depth((k >> 8) & 0x7F); }
+  Value  stress_eval(Key k)  { return Value(int(k & 0xFFF) - 0x800); }
+
+  // StressTask is run by each thread of the pool, that keeps its counters in
+  // the slot of its index.
+
+  struct StressTask : public ThreadTask {
+
+    void run(Thread* th) {
+
+      RKISS rk(73 + 7 * th->idx);
+      StressCounters& w = counters[th->idx];
+
+      for (int64_t i = 0; i < w.ops; i++)
+      {
+          Key k = StressPool[rk.rand<unsigned>() & (StressKeys - 1)];
+
+          if (rk.rand<unsigned>() & 1)
+          {
+              TT.store(k, stress_value(k), BOUND_EXACT, stress_depth(k),
+                       stress_move(k), stress_eval(k), stress_eval(~k));
+              w.stores++;
+              continue;
+          }
+
+          TTEntry ttEntry;
+          const TTEntry* tte = TT.probe(k, ttEntry);
+
+          if (!tte)
+              continue;
+
+          w.hits++;
+
+          // Age the entry as the search does after a hit, racing with the stores
+          TT.refresh(k);
+
+          if (   tte->move() != stress_move(k)
+              || tte->value() != stress_value(k)
+              || tte->depth() != stress_depth(k)
+              || tte->bound() != BOUND_EXACT
+              || tte->eval_value() != stress_eval(k)
+              || (   tte->eval_margin() != VALUE_NONE // Not stored by compact entries
+                  && tte->eval_margin() != stress_eval(~k)))
+              w.corrupted++;
+      }
+    }
+
+    vector<StressCounters> counters;
+  };
+}
+
+
+/// tt_stress() hammers the transposition table from a given number of threads
+/// of the pool, bypassing the search, and checks the data of every probe hit
+/// against the key it has been stored with. Hits are also refreshed, as done
+/// by the search, to race the generation updates with the stores. There are
+/// three parameters: the number of threads, the number of operations per
+/// thread in millions and the transposition table size in MB, kept small by
+/// default to force collisions.
+
+void tt_stress(istream& is) {
+
+  string token;
+
+  int threads = (is >> token) ? atoi(token.c_str()) : 4;
+  int mOps    = (is >> token) ? atoi(token.c_str()) : 10;
+  string ttSize = (is >> token) ? token : "1";
+
+  threads = std::max(1, std::min(threads, MAX_THREADS));
+
+  set_hash_mb(ttSize);
+  TT.clear();
+
+  RKISS rk;
+  StressPool.resize(StressKeys);
+
+  for (int i = 0; i < StressKeys; i++)
+      StressPool[i] = rk.rand<Key>();
+
+  int poolThreads = Options["Threads"];
+  Options["Threads"] = int_to_string(threads);
+
+  StressTask task;
+  StressCounters c = { int64_t(mOps) * 1000000, 0, 0, 0 };
+  task.counters.assign(threads, c);
+
+  Time::point elapsed = Time::now();
+  Threads.run(task, threads);
+
+  int64_t ops = 0, stores = 0, hits = 0, corrupted = 0;
+
+  for (int i = 0; i < threads; i++)
+  {
+      ops += task.counters[i].ops;
+      stores += task.counters[i].stores;
+      hits += task.counters[i].hits;
+      corrupted += task.counters[i].corrupted;
+  }
+
+  elapsed = Time::now() - elapsed + 1;
+
+  Options["Threads"] = int_to_string(poolThreads);
+  TT.clear(); // Don't leave stress data around for the next search
+
+  cerr << "\n==========================="
+       << "\nThreads         : " << threads
+       << "\nTotal time (ms) : " << elapsed
+       << "\nOperations      : " << ops
+       << "\nStores          : " << stores
+       << "\nProbe hits      : " << hits
+       << "\nCorrupted hits  : " << corrupted
+       << "\nOps/second      : " << 1000 * ops / elapsed << endl;
+}
+
+
+/// tt_resize() compares the time to reach a given depth after a resize of the
+/// transposition table, that keeps the entries, against a cold restart with
+/// a cleared table of the new size. For each position the table is first
+/// warmed up by a search to the given depth at the initial size. Parameters
+/// are the initial and the final hash size in MB and the warm up depth, the
+/// timed searches go two plies deeper.
+
+void tt_resize(istream& is) {
+
+  string token;
+
+  string fromSize = (is >> token) ? token : "16";
+  string toSize   = (is >> token) ? token : "64";
+  int depth       = (is >> token) ? atoi(token.c_str()) : 12;
+
+  Search::LimitsType warmLimits, limits;
+  Search::StateStackPtr st;
+  Time::point warm = 0, cold = 0;
+
+  warmLimits.depth = depth;
+  limits.depth = depth + 2;
+
+  for (size_t i = 0; i < 16; i++)
+  {
+      Position pos(Defaults[i], Options["UCI_Chess960"], Threads.main());
+
+      for (int resized = 1; resized >= 0; resized--)
+      {
+          set_hash_mb(fromSize);
+          TT.clear();
+
+          if (resized)
+          {
+              Threads.start_thinking(pos, warmLimits, vector<Move>(), st);
+              Threads.wait_for_think_finished();
+          }
+
+          Time::point elapsed = Time::now();
+
+          set_hash_mb(toSize);
+
+          if (!resized)
+              TT.clear();
+
+          Threads.start_thinking(pos, limits, vector<Move>(), st);
+          Threads.wait_for_think_finished();
+
+          (resized ? warm : cold) += Time::now() - elapsed;
+      }
+  }
+
+  cerr << "\n==========================="
+       << "\nHash resize (MB) : " << fromSize << " -> " << toSize
+       << "\nDepth            : " << depth + 2
+       << "\nResized (ms)     : " << warm
+       << "\nCold (ms)        : " << cold << endl;
+}
+
+
+/// startup_time() measures the initialization of the bitboard tables, that is
+/// what makes most of the engine startup time unless the magic bitboards have
+/// been compiled in with STATIC_MAGICS. Parameter is the number of runs.
+
+void startup_time(istream& is) {
+
+  string token;
+  int runs = (is >> token) ? std::max(atoi(token.c_str()), 1) : 100;
+
+  Time::point elapsed = Time::now();
+
+  for (int i = 0; i < runs; i++)
+      Bitboards::init();
+
+  elapsed = Time::now() - elapsed;
+
+  cerr << "\n==========================="
+#if defined(STATIC_MAGICS)
+       << "\nMagics          : static"
+#else
+       << "\nMagics          : computed"
+#endif
+       << "\nRuns            : " << runs
+       << "\nTotal time (ms) : " << elapsed
+       << "\nPer run (us)    : " << 1000 * elapsed / runs << endl;
+}
+
+
+/// smp_scaling() searches the bench positions to a fixed depth with a number of
+/// threads doubling from 1 up to the given maximum, in both SMP modes, and
+/// reports nodes per second and time to depth, also relative to one thread.
+/// Parameters are the maximum number of threads and the depth.
+
+void smp_scaling(istream& is) {
+
+  string token;
+  const char* Modes[] = { "YBWC", "Lazy SMP" };
+
+  int maxThreads = (is >> token) ? atoi(token.c_str()) : 4;
+  int depth      = (is >> token) ? atoi(token.c_str()) : 12;
+
+  int threads = Options["Threads"];
+  string mode = Options["SMP Mode"];
+  Search::LimitsType limits;
+  Search::StateStackPtr st;
+  ostringstream report;
+
+  limits.depth = depth;
+  maxThreads = std::max(1, std::min(maxThreads, MAX_THREADS));
+
+  report << "\n==========================="
+         << "\nDepth " << depth
+         << "\nMode        Threads       Nodes/second  Speedup  Time (ms)  Speedup";
+
+  for (int m = 0; m < 2; m++)
+  {
+      int64_t baseNps = 0;
+      Time::point baseTime = 0;
+
+      for (int n = 1; ; n = std::min(2 * n, maxThreads))
+      {
+          Options["Threads"] = int_to_string(n);
+          Options["SMP Mode"] = string(Modes[m]);
+
+          int64_t nodes = 0;
+          Time::point elapsed = Time::now();
+
+          for (size_t i = 0; i < 16; i++)
+          {
+              Position pos(Defaults[i], Options["UCI_Chess960"], Threads.main());
+              TT.clear();
+              Threads.start_thinking(pos, limits, vector<Move>(), st);
+              Threads.wait_for_think_finished();
+              nodes += Search::nodes_searched();
+          }
+
+          elapsed = Time::now() - elapsed + 1; // Assure positive to avoid a 'divide by zero'
+          int64_t nps = 1000 * nodes / elapsed;
+
+          if (n == 1)
+              baseNps = nps, baseTime = elapsed;
+
+          report << "\n" << left << setw(12) << Modes[m] << right
+                 << setw(7)  << n
+                 << setw(19) << nps
+                 << setw(9)  << fixed << setprecision(2) << double(nps) / baseNps
+                 << setw(11) << elapsed
+                 << setw(9)  << double(baseTime) / elapsed;
+
+          if (n == maxThreads)
+              break;
+      }
+  }
+
+  Options["Threads"] = int_to_string(threads);
+  Options["SMP Mode"] = mode;
+
+  cerr << report.str() << endl;
+}
+
+
+/// analyse_epd() searches the EPD records from 'first' on, stepping by 'step',
+/// and prints each one back to 'out' as soon as it is done, with the best move
+/// (bm), the score in centipawns (ce) and the depth reached (acd) in place of
+/// any previous ones. The search output is silenced meanwhile.
+
+static void analyse_epd(const vector<string>& records, size_t first, size_t step,
+                        const Search::LimitsType& limits, FILE* out) {
+
+  Search::StateStackPtr st;
+  streambuf* buf = cout.rdbuf(NULL);
+
+  for (size_t i = first; i < records.size(); i += step)
+  {
+      istringstream is(records[i]);
+      string fen, token;
+
+      for (int f = 0; f < 4 && is >> token; f++)
+          fen += token + " ";
+
+      Position pos(fen, Options["UCI_Chess960"], Threads.main());
+
+      Threads.start_thinking(pos, limits, vector<Move>(), st);
+      Threads.wait_for_think_finished();
+
+      // When there are no legal moves the search does not set a score
+      const Search::RootMove& rm = Search::RootMoves[0];
+      Value v = rm.pv[0] != MOVE_NONE ? rm.score : pos.checkers() ? mated_in(1) : VALUE_DRAW;
+
+      // Mate scores count the plies from the root, that is at ply 1
+      int ce =  v >= VALUE_MATE_IN_MAX_PLY  ?  32767 - (VALUE_MATE - v - 1)
+              : v <= VALUE_MATED_IN_MAX_PLY ? -32767 + (VALUE_MATE + v - 1)
+                                            : v * 100 / int(PawnValueEg);
+      ostringstream epd;
+      epd << fen;
+
+      if (rm.pv[0] != MOVE_NONE)
+          epd << "bm " << move_to_san(pos, rm.pv[0]) << "; ";
+
+      epd << "ce " << ce << "; acd " << (rm.pv[0] != MOVE_NONE ? Threads.main()->completedDepth : 0) << ";";
+
+      // Keep the other operations of the record, each one starts with a space
+      while (getline(is, token, ';'))
+      {
+          istringstream op(token);
+          string opcode;
+
+          if (op >> opcode && opcode != "bm" && opcode != "ce" && opcode != "acd")
+              epd << token << ";";
+      }
+
+      epd << "\n";
+      fputs(epd.str().c_str(), out);
+      fflush(out); // In one write, records of different jobs don't mix
+  }
+
+  cout.rdbuf(buf);
+  cout.clear();
+}
+
+
+#if !defined(_WIN32)
+
+/// spawn_engine() starts a new process of this engine, as on Linux found from
+/// /proc/self/exe, with its stdout redirected to /dev/null and fed on stdin
+/// with the UCI options we changed from their defaults, followed by 'cmd'
+/// and by a quit. Being a fresh process it has just one search thread and no
+/// state but the one set up by those commands. Returns the process id, or -1
+/// if the process could not be started.
+
+static pid_t spawn_engine(const string& cmd) {
+
+  string token;
+  istringstream options(UCI::setoption_commands(Options));
+  ostringstream in;
+
+  // Threads is left at its default of one
+  while (getline(options, token))
+      if (token.find("setoption name Threads value") != 0)
+          in << token << "\n";
+
+  in << cmd << "\nquit\n";
+
+  int p[2];
+  pid_t pid = -1;
+  posix_spawn_file_actions_t fa;
+  char name[] = "stockfish";
+  char* argv[] = { name, NULL };
+
+  if (pipe(p))
+      return -1;
+
+  // The pipe ends must not leak into the other jobs
+  fcntl(p[0], F_SETFD, FD_CLOEXEC);
+  fcntl(p[1], F_SETFD, FD_CLOEXEC);
+
+  posix_spawn_file_actions_init(&fa);
+  posix_spawn_file_actions_adddup2(&fa, p[0], STDIN_FILENO);
+  posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+  if (posix_spawn(&pid, "/proc/self/exe", &fa, NULL, argv, environ))
+      pid = -1;
+
+  posix_spawn_file_actions_destroy(&fa);
+  close(p[0]);
+
+  // Commands are much smaller than the pipe buffer, so this does not block
+  if (pid != -1 && write(p[1], in.str().c_str(), in.str().size()) < 0)
+      kill(pid, SIGKILL), waitpid(pid, NULL, 0), pid = -1;
+
+  close(p[1]);
+  return pid;
+}
+
+#endif
+
+
+/// analyse() annotates the positions of an EPD file for bulk database work,
+/// where throughput matters more than the time to a given depth. Positions are
+/// split among 'jobs' processes of this engine, each one searching with a
+/// single thread and so with its own root state, pawn, material and history
+/// tables. Results are printed as they come. Parameters are the file name, the
+/// limit type (depth, nodes or movetime), the limit value, the number of jobs
+/// and optionally "shared", to share the hash table among the jobs instead of
+/// giving each one its own. Jobs are started with "job <n> out <fd>", plus
+/// "tt <fd>" when sharing, to search their slice of the positions and write
+/// the records to the given descriptor. Without posix_spawn(), as on Windows,
+/// positions are searched one after another by this process.
+
+void analyse(istream& is) {
+
+  string token;
+  Search::LimitsType limits;
+  vector<string> records;
+
+  string fileName  = (is >> token) ? token : "";
+  string limitType = (is >> token) ? token : "depth";
+  int limit        = (is >> token) ? atoi(token.c_str()) : 12;
+  int jobs         = (is >> token) ? std::max(atoi(token.c_str()), 1) : 1;
+  bool shareTT     = false;
+  int job = -1, outFd = -1, ttFd = -1;
+
+  while (is >> token)
+      if (token == "shared")
+          shareTT = true;
+      else if (token == "job")
+          is >> job;
+      else if (token == "out")
+          is >> outFd;
+      else if (token == "tt")
+          is >> ttFd;
+
+  if (limitType == "nodes")
+      limits.nodes = limit;
+
+  else if (limitType == "movetime")
+      limits.movetime = limit;
+
+  else
+      limits.depth = limit;
+
+  ifstream file(fileName.c_str());
+
+  if (!file.is_open())
+  {
+      cerr << "Unable to open file " << fileName << endl;
+      return;
+  }
+
+  while (getline(file, token))
+      if (!token.empty())
+          records.push_back(token);
+
+#if !defined(_WIN32)
+
+  // We are a job started below, search our slice and leave the report to
+  // the process that started us.
+  if (job >= 0)
+  {
+      FILE* out = fdopen(outFd, "w");
+
+      if (!out)
+          return;
+
+      if (ttFd >= 0 && !TT.attach(ttFd))
+          cerr << "Unable to attach the shared hash table" << endl;
+
+      analyse_epd(records, job, jobs, limits, out);
+      fclose(out);
+      return;
+  }
+
+#endif
+
+  Time::point elapsed = Time::now();
+
+#if defined(_WIN32)
+  jobs = 1;
+#endif
+
+  if (jobs == 1)
+      analyse_epd(records, 0, 1, limits, stdout);
+
+#if !defined(_WIN32)
+  else
+  {
+      vector<pid_t> children;
+      vector<int> failed;
+
+      if (shareTT && !TT.set_shared(true))
+          cerr << "Unable to share the hash table, each job has its own" << endl;
+
+      // Records are written by the jobs to our stdout, through a descriptor
+      // they inherit, as their own stdout is taken by the engine output.
+      cout.flush();
+      fflush(stdout);
+      int out = dup(STDOUT_FILENO);
+
+      for (int j = 0; j < jobs; j++)
+      {
+          ostringstream cmd;
+          cmd << "analyse " << fileName << " " << limitType << " " << limit
+              << " " << jobs << " job " << j << " out " << out;
+
+          if (TT.shared_fd() != -1)
+              cmd << " tt " << TT.shared_fd();
+
+          pid_t pid = out != -1 ? spawn_engine(cmd.str()) : -1;
+
+          if (pid > 0)
+              children.push_back(pid);
+          else
+              failed.push_back(j);
+      }
+
+      // Search ourselves the positions of the jobs we could not start
+      for (size_t j = 0; j < failed.size(); j++)
+          analyse_epd(records, failed[j], jobs, limits, stdout);
+
+      for (size_t j = 0; j < children.size(); j++)
+          waitpid(children[j], NULL, 0);
+
+      if (out != -1)
+          close(out);
+
+      if (shareTT)
+          TT.set_shared(false);
+  }
+#endif
+
+  elapsed = Time::now() - elapsed + 1; // Assure positive to avoid a 'divide by zero'
+
+  cerr << "\n==========================="
+       << "\nPositions       : " << records.size()
+       << "\nJobs            : " << jobs
+       << "\nTotal time (ms) : " << elapsed
+       << "\nPositions/second: " << 1000 * records.size() / elapsed << endl;
+}
+
+
+/// eval_cost() walks all the legal move sequences of a given depth from the
+/// bench positions twice, first just making and unmaking the moves, then also
+/// evaluating the leaves that are not in check, with the evaluation cache cut
+/// down to a single entry. The difference gives the cost of an evaluation, to
+/// be compared with and without ATTACK_MAPS, that instead make do_move() and
+/// undo_move() slower. Parameter is the depth, 3 plies by default.
+
+static int64_t walk(Position& pos, int depth, bool evaluate, int64_t& leaves) {
+
+  StateInfo st;
+  CheckInfo ci(pos);
+  Value margin;
+  int64_t sum = 0;
+
+  for (MoveList<LEGAL> it(pos); *it; ++it)
+  {
+      pos.do_move(*it, st, ci, pos.move_gives_check(*it, ci));
+
+      if (depth > 1)
+          sum += walk(pos, depth - 1, evaluate, leaves);
+
+      else if (!pos.checkers())
+      {
+          leaves++;
+
+          if (evaluate)
+              sum += Eval::evaluate(pos, margin);
+      }
+
+      pos.undo_move(*it);
+  }
+
+  return sum;
+}
+
+void eval_cost(istream& is) {
+
+  string token;
+  int depth = (is >> token) ? std::max(atoi(token.c_str()), 1) : 3;
+  int64_t elapsed[2] = {}, leaves[2] = {}, sum = 0;
+
+  Threads.main()->evalTable.resize(0);
+
+  for (int evaluate = 0; evaluate <= 1; evaluate++)
+      for (size_t i = 0; i < 16; i++)
+      {
+          Position pos(Defaults[i], false, Threads.main());
+          int64_t start = Time::now_usec();
+
+          sum += walk(pos, depth, evaluate, leaves[evaluate]);
+          elapsed[evaluate] += Time::now_usec() - start;
+      }
+
+  Threads.main()->evalTable.resize(Options["Eval Hash KB"]);
+
+  cerr << "\n==========================="
+#if defined(ATTACK_MAPS)
+       << "\nAttack maps          : incremental"
+#else
+       << "\nAttack maps          : none"
+#endif
+       << "\nDepth                : " << depth
+       << "\nLeaves               : " << leaves[0]
+       << "\nWalk per leaf (ns)   : " << 1000 * elapsed[0] / leaves[0]
+       << "\nEval per leaf (ns)   : " << 1000 * (elapsed[1] - elapsed[0]) / leaves[0]
+       << "\nChecksum             : " << sum << endl;
+}
+
+
+// magic_attacks() computes the union of the slider attacks of both sides one
+// piece at a time with the magic bitboards, as evaluation does.
+
+static void magic_attacks(Bitboard occupied, const Bitboard rooks[],
+                          const Bitboard bishops[], Bitboard attacks[]) {
+
+  for (Color c = WHITE; c <= BLACK; c++)
+  {
+      attacks[c] = 0;
+
+      for (Bitboard b = rooks[c]; b; )
+          attacks[c] |= attacks_bb<ROOK>(pop_lsb(&b), occupied);
+
+      for (Bitboard b = bishops[c]; b; )
+          attacks[c] |= attacks_bb<BISHOP>(pop_lsb(&b), occupied);
+  }
+}
+
+/// setwise_attacks() benchmarks the optional set-wise slider attacks backend
+/// against the magic bitboards, computing the union of the slider attacks of
+/// both sides in the bench positions. Each pass adds a few blockers on the
+/// third rank, so that the work cannot be hoisted out of the loop, and all
+/// these occupancies are first checked to give the same attacks both ways.
+/// Parameter is the number of passes over the 16 positions.
+
+void setwise_attacks(istream& is) {
+
+  string token;
+  int runs = (is >> token) ? std::max(atoi(token.c_str()), 1) : 100000;
+
+  Bitboard occupied[16], rooks[16][COLOR_NB], bishops[16][COLOR_NB];
+  Bitboard attacks[COLOR_NB], expected[COLOR_NB], sum = 0;
+  Time::point elapsed[2] = {};
+  bool match = true;
+
+  for (size_t i = 0; i < 16; i++)
+  {
+      Position pos(Defaults[i], false, Threads.main());
+
+      occupied[i] = pos.pieces();
+
+      for (Color c = WHITE; c <= BLACK; c++)
+      {
+          rooks[i][c] = pos.pieces(c, ROOK, QUEEN);
+          bishops[i][c] = pos.pieces(c, BISHOP, QUEEN);
+      }
+
+      for (int r = 0; r < 8; r++)
+      {
+          Bitboard occ = occupied[i] | (Bitboard(r) << 16);
+
+          magic_attacks(occ, rooks[i], bishops[i], expected);
+          Bitboards::sliding_attacks_setwise(occ, rooks[i], bishops[i], attacks);
+          match = match && attacks[WHITE] == expected[WHITE] && attacks[BLACK] == expected[BLACK];
+      }
+  }
+
+  for (int setwise = 0; setwise <= 1; setwise++)
+  {
+      Time::point start = Time::now();
+
+      for (int r = 0; r < runs; r++)
+          for (size_t i = 0; i < 16; i++)
+          {
+              Bitboard occ = occupied[i] | (Bitboard(r & 7) << 16);
+
+              if (setwise)
+                  Bitboards::sliding_attacks_setwise(occ, rooks[i], bishops[i], attacks);
+              else
+                  magic_attacks(occ, rooks[i], bishops[i], attacks);
+
+              sum += attacks[WHITE] ^ attacks[BLACK];
+          }
+
+      elapsed[setwise] = Time::now() - start;
+  }
+
+  cerr << "\n==========================="
+#if defined(USE_AVX2)
+       << "\nSet-wise backend     : AVX2"
+#elif defined(__SSE2__)
+       << "\nSet-wise backend     : SSE2"
+#else
+       << "\nSet-wise backend     : scalar"
+#endif
+       << "\nPasses               : " << runs
+       << "\nMagics (ns/pos)      : " << 1000000 * elapsed[0] / (16 * runs)
+       << "\nSet-wise (ns/pos)    : " << 1000000 * elapsed[1] / (16 * runs)
+       << "\nResults              : " << (match ? "match" : "differ")
+       << "\nChecksum             : " << sum << endl;
 }
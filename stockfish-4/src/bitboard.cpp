@@ -19,6 +19,7 @@
 
 #include <algorithm>
 #include <cstring>
+#include <fstream>
 #include <iostream>
 
 #include "bitboard.h"
@@ -26,6 +27,18 @@
 #include "misc.h"
 #include "rkiss.h"
 
+#if defined(USE_AVX2)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+#if defined(STATIC_MAGICS)
+
+#include "magics.h"
+
+#else
+
 CACHE_LINE_ALIGNMENT
 
 Bitboard RMasks[SQUARE_NB];
@@ -38,6 +51,8 @@ Bitboard BMagics[SQUARE_NB];
 Bitboard* BAttacks[SQUARE_NB];
 unsigned BShifts[SQUARE_NB];
 
+#endif
+
 Bitboard SquareBB[SQUARE_NB];
 Bitboard FileBB[FILE_NB];
 Bitboard RankBB[RANK_NB];
@@ -63,6 +78,8 @@ namespace {
 
   int MS1BTable[256];
   Square BSFTable[SQUARE_NB];
+
+#if !defined(STATIC_MAGICS)
   Bitboard RTable[0x19000]; // Storage space for rook attacks
   Bitboard BTable[0x1480];  // Storage space for bishop attacks
 
@@ -70,6 +87,7 @@ namespace {
 
   void init_magics(Bitboard table[], Bitboard* attacks[], Bitboard magics[],
                    Bitboard masks[], unsigned shifts[], Square deltas[], Fn index);
+#endif
 
   FORCE_INLINE unsigned bsf_index(Bitboard b) {
 
@@ -205,11 +223,13 @@ void Bitboards::init() {
                       StepAttacksBB[make_piece(c, pt)][s] |= to;
               }
 
+#if !defined(STATIC_MAGICS)
   Square RDeltas[] = { DELTA_N,  DELTA_E,  DELTA_S,  DELTA_W  };
   Square BDeltas[] = { DELTA_NE, DELTA_SE, DELTA_SW, DELTA_NW };
 
   init_magics(RTable, RAttacks, RMagics, RMasks, RShifts, RDeltas, magic_index<ROOK>);
   init_magics(BTable, BAttacks, BMagics, BMasks, BShifts, BDeltas, magic_index<BISHOP>);
+#endif
 
   for (Square s = SQ_A1; s <= SQ_H8; s++)
   {
@@ -229,6 +249,8 @@ void Bitboards::init() {
 }
 
 
+#if !defined(STATIC_MAGICS)
+
 namespace {
 
   Bitboard sliding_attack(Square deltas[], Square sq, Bitboard occupied) {
@@ -308,6 +330,15 @@ namespace {
         if (s < SQ_H8)
             attacks[s + 1] = attacks[s] + size;
 
+        // With pext the index is known in advance, no magic to look for
+        if (HasPext)
+        {
+            for (i = 0; i < size; i++)
+                attacks[s][index(s, occupancy[i])] = reference[i];
+
+            continue;
+        }
+
         booster = MagicBoosters[Is64Bit][rank_of(s)];
 
         // Find a magic for square 's' picking up an (almost) random number
@@ -337,3 +368,203 @@ namespace {
     }
   }
 }
+
+#endif // !defined(STATIC_MAGICS)
+
+
+namespace {
+
+  // write_table() writes the definition of an array of integers in C++ syntax,
+  // as hex literals, four per line.
+
+  template<typename T>
+  void write_table(std::ofstream& f, const char* decl, const T* data, int size) {
+
+    f << decl << " = {" << std::hex;
+
+    for (int i = 0; i < size; i++)
+        f << (i % 4 ? " " : "\n  ") << "0x" << uint64_t(data[i])
+          << (sizeof(T) > 4 ? "ULL" : "U") << (i < size - 1 ? "," : "");
+
+    f << std::dec << "\n};\n\n";
+  }
+
+  void write_attacks(std::ofstream& f, const char* decl, const char* table,
+                     const Bitboard* const attacks[]) {
+
+    f << decl << " = {";
+
+    for (Square s = SQ_A1; s <= SQ_H8; s++)
+        f << (s % 4 ? " " : "\n  ") << table << " + " << (attacks[s] - attacks[SQ_A1])
+          << (s < SQ_H8 ? "," : "");
+
+    f << "\n};\n\n";
+  }
+}
+
+
+/// Bitboards::write_magics() writes the magic bitboard tables to a C++ header,
+/// to be compiled in with STATIC_MAGICS so that they are not computed at each
+/// startup. Tables depend on the word size, the header checks it is compiled
+/// for the same one.
+
+bool Bitboards::write_magics(const std::string& fileName) {
+
+  std::ofstream f(fileName.c_str());
+
+  f << "// Magic bitboard tables generated by the 'magics' command, do not edit.\n\n"
+    << "#if " << (Is64Bit ? "!" : "") << "defined(IS_64BIT)\n"
+    << "#  error \"" << fileName << " has been generated for a different word size\"\n"
+    << "#endif\n\n"
+    << "#if " << (HasPext ? "!" : "") << "defined(USE_PEXT)\n"
+    << "#  error \"" << fileName << " has been generated for a different slider indexing\"\n"
+    << "#endif\n\n"
+    << "namespace {\n\n"
+    << "CACHE_LINE_ALIGNMENT\n\n";
+
+  write_table(f, "const Bitboard RTable[0x19000]", RAttacks[SQ_A1], 0x19000);
+  write_table(f, "const Bitboard BTable[0x1480]", BAttacks[SQ_A1], 0x1480);
+
+  f << "}\n\nCACHE_LINE_ALIGNMENT\n\n";
+
+  write_table(f, "const Bitboard RMasks[SQUARE_NB]", RMasks, SQUARE_NB);
+  write_table(f, "const Bitboard RMagics[SQUARE_NB]", RMagics, SQUARE_NB);
+  write_attacks(f, "const Bitboard* const RAttacks[SQUARE_NB]", "RTable", RAttacks);
+  write_table(f, "const unsigned RShifts[SQUARE_NB]", RShifts, SQUARE_NB);
+
+  write_table(f, "const Bitboard BMasks[SQUARE_NB]", BMasks, SQUARE_NB);
+  write_table(f, "const Bitboard BMagics[SQUARE_NB]", BMagics, SQUARE_NB);
+  write_attacks(f, "const Bitboard* const BAttacks[SQUARE_NB]", "BTable", BAttacks);
+  write_table(f, "const unsigned BShifts[SQUARE_NB]", BShifts, SQUARE_NB);
+
+  return bool(f);
+}
+
+
+namespace {
+
+  // Kogge-Stone occluded fill of the sliders in 'gen' along the direction
+  // given by Shift, through the empty squares. Mask excludes the squares that
+  // would be reached by wrapping around the a or h file, attacks are then the
+  // fill shifted one more step.
+
+  template<int Shift> Bitboard shift(Bitboard b) {
+    return Shift > 0 ? b << (Shift & 63) : b >> (-Shift & 63);
+  }
+
+  template<int Shift> Bitboard edge_mask() {
+    return Shift == 8 || Shift == -8 ? ~Bitboard(0)
+         : Shift == 1 || Shift == 9 || Shift == -7 ? ~FileABB : ~FileHBB;
+  }
+
+  template<int Shift>
+  Bitboard fill_attacks(Bitboard gen, Bitboard empty) {
+
+    Bitboard pro = empty & edge_mask<Shift>();
+
+    gen |= pro & shift<Shift>(gen);
+    pro &=       shift<Shift>(pro);
+    gen |= pro & shift<2 * Shift>(gen);
+    pro &=       shift<2 * Shift>(pro);
+    gen |= pro & shift<4 * Shift>(gen);
+
+    return shift<Shift>(gen) & edge_mask<Shift>();
+  }
+
+#if !defined(USE_AVX2) && defined(__SSE2__)
+
+  // With SSE2 the two 64 bit lanes hold the sliders of the two colors, so that
+  // each direction is filled for both at once.
+
+  template<int Shift> __m128i shift(__m128i b) {
+    return Shift > 0 ? _mm_slli_epi64(b, Shift & 63) : _mm_srli_epi64(b, -Shift & 63);
+  }
+
+  template<int Shift>
+  __m128i fill_attacks(__m128i gen, __m128i empty) {
+
+    const __m128i mask = _mm_set1_epi64x(edge_mask<Shift>());
+    __m128i pro = _mm_and_si128(empty, mask);
+
+    gen = _mm_or_si128(gen, _mm_and_si128(pro, shift<Shift>(gen)));
+    pro = _mm_and_si128(pro, shift<Shift>(pro));
+    gen = _mm_or_si128(gen, _mm_and_si128(pro, shift<2 * Shift>(gen)));
+    pro = _mm_and_si128(pro, shift<2 * Shift>(pro));
+    gen = _mm_or_si128(gen, _mm_and_si128(pro, shift<4 * Shift>(gen)));
+
+    return _mm_and_si128(shift<Shift>(gen), mask);
+  }
+
+#endif
+
+}
+
+
+/// Bitboards::sliding_attacks_setwise() computes for both colors the union of
+/// the attacks of all the given rook-like and bishop-like sliders at once,
+/// with occluded fills instead of one magic lookup per piece. Queens have to
+/// be included in both sets. With AVX2 the four directions of a slider type
+/// are filled in parallel, one per 64 bit lane, with SSE2 each direction is
+/// filled for both colors at once.
+
+void Bitboards::sliding_attacks_setwise(Bitboard occupied, const Bitboard rooks[],
+                                        const Bitboard bishops[], Bitboard attacks[]) {
+#if defined(USE_AVX2)
+
+  // Lanes are north, east, north-east and north-west with left shifts, south,
+  // west, south-west and south-east with right shifts.
+  const __m256i s1 = _mm256_set_epi64x(7, 9, 1, 8);
+  const __m256i s2 = _mm256_add_epi64(s1, s1);
+  const __m256i s4 = _mm256_add_epi64(s2, s2);
+  const __m256i lmask = _mm256_set_epi64x(~FileHBB, ~FileABB, ~FileABB, ~Bitboard(0));
+  const __m256i rmask = _mm256_set_epi64x(~FileABB, ~FileHBB, ~FileHBB, ~Bitboard(0));
+  const __m256i empty = _mm256_set1_epi64x(~occupied);
+
+  for (Color c = WHITE; c <= BLACK; c++)
+  {
+      __m256i lgen = _mm256_set_epi64x(bishops[c], bishops[c], rooks[c], rooks[c]);
+      __m256i rgen = lgen;
+      __m256i lpro = _mm256_and_si256(empty, lmask);
+      __m256i rpro = _mm256_and_si256(empty, rmask);
+
+      lgen = _mm256_or_si256(lgen, _mm256_and_si256(lpro, _mm256_sllv_epi64(lgen, s1)));
+      rgen = _mm256_or_si256(rgen, _mm256_and_si256(rpro, _mm256_srlv_epi64(rgen, s1)));
+      lpro = _mm256_and_si256(lpro, _mm256_sllv_epi64(lpro, s1));
+      rpro = _mm256_and_si256(rpro, _mm256_srlv_epi64(rpro, s1));
+      lgen = _mm256_or_si256(lgen, _mm256_and_si256(lpro, _mm256_sllv_epi64(lgen, s2)));
+      rgen = _mm256_or_si256(rgen, _mm256_and_si256(rpro, _mm256_srlv_epi64(rgen, s2)));
+      lpro = _mm256_and_si256(lpro, _mm256_sllv_epi64(lpro, s2));
+      rpro = _mm256_and_si256(rpro, _mm256_srlv_epi64(rpro, s2));
+      lgen = _mm256_or_si256(lgen, _mm256_and_si256(lpro, _mm256_sllv_epi64(lgen, s4)));
+      rgen = _mm256_or_si256(rgen, _mm256_and_si256(rpro, _mm256_srlv_epi64(rgen, s4)));
+
+      __m256i a = _mm256_or_si256(_mm256_and_si256(_mm256_sllv_epi64(lgen, s1), lmask),
+                                  _mm256_and_si256(_mm256_srlv_epi64(rgen, s1), rmask));
+      __m128i h = _mm_or_si128(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+      h = _mm_or_si128(h, _mm_unpackhi_epi64(h, h));
+      _mm_storel_epi64((__m128i*)&attacks[c], h);
+  }
+
+#elif defined(__SSE2__)
+
+  const __m128i empty = _mm_set1_epi64x(~occupied);
+  const __m128i r = _mm_set_epi64x(rooks[BLACK], rooks[WHITE]);
+  const __m128i b = _mm_set_epi64x(bishops[BLACK], bishops[WHITE]);
+
+  __m128i a = _mm_or_si128(_mm_or_si128(fill_attacks< 8>(r, empty), fill_attacks<-8>(r, empty)),
+                           _mm_or_si128(fill_attacks< 1>(r, empty), fill_attacks<-1>(r, empty)));
+  a = _mm_or_si128(a, _mm_or_si128(_mm_or_si128(fill_attacks< 9>(b, empty), fill_attacks<-9>(b, empty)),
+                                   _mm_or_si128(fill_attacks< 7>(b, empty), fill_attacks<-7>(b, empty))));
+
+  _mm_storel_epi64((__m128i*)&attacks[WHITE], a);
+  _mm_storel_epi64((__m128i*)&attacks[BLACK], _mm_unpackhi_epi64(a, a));
+
+#else
+
+  for (Color c = WHITE; c <= BLACK; c++)
+      attacks[c] =  fill_attacks< 8>(rooks[c], ~occupied)   | fill_attacks<-8>(rooks[c], ~occupied)
+                  | fill_attacks< 1>(rooks[c], ~occupied)   | fill_attacks<-1>(rooks[c], ~occupied)
+                  | fill_attacks< 9>(bishops[c], ~occupied) | fill_attacks<-9>(bishops[c], ~occupied)
+                  | fill_attacks< 7>(bishops[c], ~occupied) | fill_attacks<-7>(bishops[c], ~occupied);
+#endif
+}
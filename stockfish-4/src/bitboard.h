@@ -21,12 +21,21 @@
 #ifndef BITBOARD_H_INCLUDED
 #define BITBOARD_H_INCLUDED
 
+#include <string>
+
 #include "types.h"
 
 namespace Bitboards {
 
 void init();
 void print(Bitboard b);
+bool write_magics(const std::string& fileName);
+
+// Optional backend for the unions of slider attacks, not used by the search
+// or the evaluation that need the attacks piece by piece. See the "setwise"
+// benchmark command.
+void sliding_attacks_setwise(Bitboard occupied, const Bitboard rooks[], const Bitboard bishops[],
+                             Bitboard attacks[]);
 
 }
 
@@ -55,17 +64,27 @@ const Bitboard Rank6BB = Rank1BB << (8 * 5);
 const Bitboard Rank7BB = Rank1BB << (8 * 6);
 const Bitboard Rank8BB = Rank1BB << (8 * 7);
 
+/// With STATIC_MAGICS the magic bitboard tables are read-only data compiled in
+/// from magics.h, as generated by the 'magics' command, instead of being
+/// computed at startup.
+
+#if defined(STATIC_MAGICS)
+#  define MAGICS_CONST const
+#else
+#  define MAGICS_CONST
+#endif
+
 CACHE_LINE_ALIGNMENT
 
-extern Bitboard RMasks[SQUARE_NB];
-extern Bitboard RMagics[SQUARE_NB];
-extern Bitboard* RAttacks[SQUARE_NB];
-extern unsigned RShifts[SQUARE_NB];
+extern MAGICS_CONST Bitboard RMasks[SQUARE_NB];
+extern MAGICS_CONST Bitboard RMagics[SQUARE_NB];
+extern MAGICS_CONST Bitboard* MAGICS_CONST RAttacks[SQUARE_NB];
+extern MAGICS_CONST unsigned RShifts[SQUARE_NB];
 
-extern Bitboard BMasks[SQUARE_NB];
-extern Bitboard BMagics[SQUARE_NB];
-extern Bitboard* BAttacks[SQUARE_NB];
-extern unsigned BShifts[SQUARE_NB];
+extern MAGICS_CONST Bitboard BMasks[SQUARE_NB];
+extern MAGICS_CONST Bitboard BMagics[SQUARE_NB];
+extern MAGICS_CONST Bitboard* MAGICS_CONST BAttacks[SQUARE_NB];
+extern MAGICS_CONST unsigned BShifts[SQUARE_NB];
 
 extern Bitboard SquareBB[SQUARE_NB];
 extern Bitboard FileBB[FILE_NB];
@@ -234,12 +253,17 @@ inline bool squares_aligned(Square s1, Square s2, Square s3) {
 /// Functions for computing sliding attack bitboards. Function attacks_bb() takes
 /// a square and a bitboard of occupied squares as input, and returns a bitboard
 /// representing all squares attacked by Pt (bishop or rook) on the given square.
+/// With BMI2 the index is just the occupancy bits of the mask, extracted with
+/// pext, and the magics are not used.
 template<PieceType Pt>
 FORCE_INLINE unsigned magic_index(Square s, Bitboard occ) {
 
-  Bitboard* const Masks  = Pt == ROOK ? RMasks  : BMasks;
-  Bitboard* const Magics = Pt == ROOK ? RMagics : BMagics;
-  unsigned* const Shifts = Pt == ROOK ? RShifts : BShifts;
+  MAGICS_CONST Bitboard* const Masks  = Pt == ROOK ? RMasks  : BMasks;
+  MAGICS_CONST Bitboard* const Magics = Pt == ROOK ? RMagics : BMagics;
+  MAGICS_CONST unsigned* const Shifts = Pt == ROOK ? RShifts : BShifts;
+
+  if (HasPext)
+      return unsigned(pext(occ, Masks[s]));
 
   if (Is64Bit)
       return unsigned(((occ & Masks[s]) * Magics[s]) >> Shifts[s]);
@@ -111,6 +111,8 @@ class Endgames {
 
   M1& map(M1::mapped_type) { return m1; }
   M2& map(M2::mapped_type) { return m2; }
+  const M1& map(M1::mapped_type) const { return m1; }
+  const M2& map(M2::mapped_type) const { return m2; }
 
   template<EndgameType E> void add(const std::string& code);
 
@@ -118,8 +120,10 @@ public:
   Endgames();
  ~Endgames();
 
-  template<typename T> T probe(Key key, T& eg)
-  { return eg = map(eg).count(key) ? map(eg)[key] : NULL; }
+  template<typename T> T probe(Key key, T& eg) const {
+    typename std::map<Key, T>::const_iterator it = map(eg).find(key);
+    return eg = (it != map(eg).end() ? it->second : NULL);
+  }
 };
 
 #endif // #ifndef ENDGAME_H_INCLUDED
@@ -92,6 +92,9 @@ namespace {
   enum { Mobility, PawnStructure, PassedPawns, Space, KingDangerUs, KingDangerThem };
   Score Weights[6];
 
+  // Lazy evaluation margin, initialized from UCI options. Zero means disabled
+  Value LazyMargin;
+
   typedef Value V;
   #define S(mg, eg) make_score(mg, eg)
 
@@ -230,7 +233,7 @@ namespace {
 
   // Function prototypes
   template<bool Trace>
-  Value do_evaluate(const Position& pos, Value& margin);
+  Value do_evaluate(const Position& pos, Value& margin, Value alpha, Value beta, bool& lazy);
 
   template<Color Us>
   void init_eval_info(const Position& pos, EvalInfo& ei);
@@ -263,10 +266,48 @@ namespace Eval {
 
   /// evaluate() is the main evaluation function. It always computes two
   /// values, an endgame score and a middle game score, and interpolates
-  /// between them based on the remaining material.
+  /// between them based on the remaining material. Results are cached in
+  /// the evaluation table of the thread, looked up first.
 
   Value evaluate(const Position& pos, Value& margin) {
-    return do_evaluate<false>(pos, margin);
+
+    bool lazy;
+    return evaluate(pos, margin, -VALUE_INFINITE, VALUE_INFINITE, lazy);
+  }
+
+
+  /// With a "Lazy Eval Margin", when the cheap terms alone put the score that
+  /// far outside the (alpha, beta) window, evaluate() returns it with the lazy
+  /// margin as its uncertainty margin and sets 'lazy'. Such a value is good
+  /// only against this window, so it is not cached and the caller must not
+  /// store it as a static evaluation.
+
+  Value evaluate(const Position& pos, Value& margin, Value alpha, Value beta, bool& lazy) {
+
+    lazy = false;
+
+    Table& entries = pos.this_thread()->evalTable;
+    Entry* e = entries[pos.key()];
+    uint32_t key32 = uint32_t(pos.key() >> 32);
+
+    entries.probes++;
+
+    if (e->key == key32)
+    {
+        entries.hits++;
+        margin = Value(e->margin);
+        return Value(e->value);
+    }
+
+    Value v = do_evaluate<false>(pos, margin, alpha, beta, lazy);
+
+    if (lazy)
+        return v;
+
+    e->key = key32;
+    e->value = int16_t(v);
+    e->margin = int16_t(margin);
+    return v;
   }
 
 
@@ -290,6 +331,8 @@ namespace Eval {
     Weights[KingDangerUs]   = weight_option("Cowardice", "Cowardice", WeightsInternal[KingDangerUs]);
     Weights[KingDangerThem] = weight_option("Aggressiveness", "Aggressiveness", WeightsInternal[KingDangerThem]);
 
+    LazyMargin = Value(Options["Lazy Eval Margin"] * int(PawnValueEg) / 100); // From centipawns
+
     const int MaxSlope = 30;
     const int Peak = 1280;
 
@@ -308,7 +351,7 @@ namespace Eval {
 namespace {
 
 template<bool Trace>
-Value do_evaluate(const Position& pos, Value& margin) {
+Value do_evaluate(const Position& pos, Value& margin, Value alpha, Value beta, bool& lazy) {
 
   assert(!pos.checkers());
 
@@ -327,7 +370,7 @@ Value do_evaluate(const Position& pos, Value& margin) {
   score = pos.psq_score() + (pos.side_to_move() == WHITE ? Tempo : -Tempo);
 
   // Probe the material hash table
-  ei.mi = Material::probe(pos, th->materialTable, th->endgames);
+  ei.mi = Material::probe(pos, th->materialTable, *Threads.endgames);
   score += ei.mi->material_value();
 
   // If we have a specialized evaluation function for the current material
@@ -342,6 +385,21 @@ Value do_evaluate(const Position& pos, Value& margin) {
   ei.pi = Pawns::probe(pos, th->pawnsTable);
   score += apply_weight(ei.pi->pawns_value(), Weights[PawnStructure]);
 
+  // Lazy evaluation. If material, psq and pawns are already far enough outside
+  // the window, assume the other terms can't bring the score back in.
+  if (!Trace && LazyMargin)
+  {
+      Value v = interpolate(score, ei.mi->game_phase(), SCALE_FACTOR_NORMAL);
+      v = pos.side_to_move() == WHITE ? v : -v;
+
+      if (v - LazyMargin >= beta || v + LazyMargin <= alpha)
+      {
+          margin = LazyMargin;
+          lazy = true;
+          return v;
+      }
+  }
+
   // Initialize attack and king safety bitboards
   init_eval_info<WHITE>(pos, ei);
   init_eval_info<BLACK>(pos, ei);
@@ -495,9 +553,21 @@ Value do_evaluate(const Position& pos, Value& margin) {
     while ((s = *pl++) != SQ_NONE)
     {
         // Find attacked squares, including x-ray attacks for bishops and rooks
+#if defined(ATTACK_MAPS)
+        // The attack maps hold plain attacks, so look up the x-ray attacks
+        // only when there is a friendly piece to see through.
+        b = pos.attacks_of(s);
+
+        if (Piece == BISHOP && (b & pos.pieces(Us, QUEEN)))
+            b = attacks_bb<BISHOP>(s, pos.pieces() ^ pos.pieces(Us, QUEEN));
+
+        else if (Piece == ROOK && (b & pos.pieces(Us, ROOK, QUEEN)))
+            b = attacks_bb<ROOK>(s, pos.pieces() ^ pos.pieces(Us, ROOK, QUEEN));
+#else
         b = Piece == BISHOP ? attacks_bb<BISHOP>(s, pos.pieces() ^ pos.pieces(Us, QUEEN))
           : Piece ==   ROOK ? attacks_bb<  ROOK>(s, pos.pieces() ^ pos.pieces(Us, ROOK, QUEEN))
                             : pos.attacks_from<Piece>(s);
+#endif
 
         ei.attackedBy[Us][Piece] |= b;
 
@@ -1153,7 +1223,8 @@ Value do_evaluate(const Position& pos, Value& margin) {
     std::memset(scores, 0, 2 * (TOTAL + 1) * sizeof(Score));
 
     Value margin;
-    do_evaluate<true>(pos, margin);
+    bool lazy;
+    do_evaluate<true>(pos, margin, -VALUE_INFINITE, VALUE_INFINITE, lazy);
 
     std::string totals = stream.str();
     stream.str("");
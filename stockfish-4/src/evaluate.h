@@ -20,14 +20,37 @@
 #ifndef EVALUATE_H_INCLUDED
 #define EVALUATE_H_INCLUDED
 
+#include "misc.h"
 #include "types.h"
 
 class Position;
 
 namespace Eval {
 
+/// Eval::Entry caches the static evaluation and margin of a position. Entries
+/// are only accessed by their own thread, so there is no need to check for
+/// torn writes and the upper 32 bits of the key are enough.
+
+struct Entry {
+  uint32_t key;
+  int16_t value;
+  int16_t margin;
+};
+
+/// Eval::Table is the evaluation cache of a thread. It counts its probes and
+/// hits. Evaluation depends on the side to move at the root and on the UCI
+/// options, so the table is cleared at the start of every search.
+
+struct Table : public HashTable<Entry> {
+
+  Table() : probes(0), hits(0) {}
+
+  uint64_t probes, hits;
+};
+
 extern void init();
 extern Value evaluate(const Position& pos, Value& margin);
+extern Value evaluate(const Position& pos, Value& margin, Value alpha, Value beta, bool& lazy);
 extern std::string trace(const Position& pos);
 
 }
@@ -39,7 +39,7 @@ int main(int argc, char* argv[]) {
   Search::init();
   Eval::init();
   Threads.init();
-  TT.set_size(Options["Hash"]);
+  TT.set_size(UCI::hash_kb());
 
   std::string args;
 
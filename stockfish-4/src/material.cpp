@@ -139,7 +139,7 @@ namespace Material {
 /// already present in the table, it is computed and stored there, so we don't
 /// have to recompute everything when the same material configuration occurs again.
 
-Entry* probe(const Position& pos, Table& entries, Endgames& endgames) {
+Entry* probe(const Position& pos, Table& entries, const Endgames& endgames) {
 
   Key key = pos.material_key();
   Entry* e = entries[key];
@@ -54,9 +54,9 @@ struct Entry {
   Phase gamePhase;
 };
 
-typedef HashTable<Entry, 8192> Table;
+typedef HashTable<Entry> Table;
 
-Entry* probe(const Position& pos, Table& entries, Endgames& endgames);
+Entry* probe(const Position& pos, Table& entries, const Endgames& endgames);
 Phase game_phase(const Position& pos);
 
 /// Material::scale_factor takes a position and a color as input, and
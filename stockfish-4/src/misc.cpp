@@ -165,12 +165,24 @@ void timed_wait(WaitCondition& sleepCond, Lock& sleepLock, int msec) {
 
 #ifdef _WIN32
   int tm = msec;
-#else
+#elif defined(__APPLE__)
   timespec ts, *tm = &ts;
   uint64_t ms = Time::now() + msec;
 
   ts.tv_sec = ms / 1000;
   ts.tv_nsec = (ms % 1000) * 1000000LL;
+#else
+  timespec ts, *tm = &ts; // Condition variables use CLOCK_MONOTONIC, see cond_init()
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += msec / 1000;
+  ts.tv_nsec += (msec % 1000) * 1000000L;
+
+  if (ts.tv_nsec >= 1000000000L)
+  {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+  }
 #endif
 
   cond_timedwait(sleepCond, sleepLock, tm);
@@ -20,6 +20,7 @@
 #ifndef MISC_H_INCLUDED
 #define MISC_H_INCLUDED
 
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -43,16 +44,34 @@ struct Log : public std::ofstream {
 };
 
 
+/// Time points are in msec from a steady clock. coarse_now() is cheaper and
+/// meant for the search itself, but can lag behind now() by a few msec.
+
 namespace Time {
   typedef int64_t point;
-  inline point now() { return system_time_to_msec(); }
+  inline point now() { return monotonic_time_to_usec() / 1000; }
+  inline point coarse_now() { return coarse_time_to_msec(); }
+  inline int64_t now_usec() { return monotonic_time_to_usec(); }
 }
 
 
-template<class Entry, int Size>
+/// HashTable is used for the per-thread pawn and material tables. Its size is
+/// set at runtime in KB, the lower 32 bits of the key are scaled to the number
+/// of entries with a multiply-shift so that this doesn't need to be a power
+/// of 2. A new table has a single entry until resize() is called.
+
+template<class Entry>
 struct HashTable {
-  HashTable() : e(Size, Entry()) {}
-  Entry* operator[](Key k) { return &e[(uint32_t)k & (Size - 1)]; }
+  HashTable() : e(1, Entry()) {}
+  Entry* operator[](Key k) { return &e[(uint64_t(uint32_t(k)) * e.size()) >> 32]; }
+
+  void resize(size_t kbSize) {
+    size_t n = (kbSize << 10) / sizeof(Entry);
+    if (n != e.size())
+        std::vector<Entry>(n ? n : 1, Entry()).swap(e);
+  }
+
+  void clear() { std::fill(e.begin(), e.end(), Entry()); }
 
 private:
   std::vector<Entry> e;
@@ -72,6 +72,20 @@ typedef Stats<false, Value> HistoryStats;
 typedef Stats<false, std::pair<Move, Move> > CountermovesStats;
 
 
+/// MoveStats keeps together the statistics a thread updates during the search.
+/// Each thread has its own, but they can be shared among all the threads, see
+/// the "Shared History" UCI option.
+
+struct MoveStats {
+
+  void clear() { history.clear(); gains.clear(); countermoves.clear(); }
+
+  HistoryStats history;
+  GainsStats gains;
+  CountermovesStats countermoves;
+};
+
+
 /// MovePicker class is used to pick one pseudo legal move at a time from the
 /// current position. The most important method is next_move(), which returns a
 /// new pseudo legal move each time it is called, until there are no moves left,
@@ -84,9 +98,9 @@ class MovePicker {
   MovePicker& operator=(const MovePicker&); // Silence a warning under MSVC
 
 public:
-  MovePicker(const Position&, Move, Depth, const HistoryStats&, Square);
-  MovePicker(const Position&, Move, const HistoryStats&, PieceType);
-  MovePicker(const Position&, Move, Depth, const HistoryStats&, Move*, Search::Stack*);
+  MovePicker(const Position&, Move, Depth, Square);
+  MovePicker(const Position&, Move, PieceType);
+  MovePicker(const Position&, Move, Depth, Move*, Search::Stack*);
 
   template<bool SpNode> Move next_move();
 
@@ -25,6 +25,7 @@
 #include "movegen.h"
 #include "notation.h"
 #include "position.h"
+#include "search.h"
 
 using namespace std;
 
@@ -227,14 +228,16 @@ string pretty_pv(Position& pos, int depth, Value value, int64_t msecs, Move pv[]
     << setw(8) << score_to_string(value)
     << setw(8) << time_to_string(msecs);
 
-  if (pos.nodes_searched() < M)
-      s << setw(8) << pos.nodes_searched() / 1 << "  ";
+  int64_t nodes = Search::nodes_searched();
 
-  else if (pos.nodes_searched() < K * M)
-      s << setw(7) << pos.nodes_searched() / K << "K  ";
+  if (nodes < M)
+      s << setw(8) << nodes / 1 << "  ";
+
+  else if (nodes < K * M)
+      s << setw(7) << nodes / K << "K  ";
 
   else
-      s << setw(7) << pos.nodes_searched() / M << "M  ";
+      s << setw(7) << nodes / M << "M  ";
 
   padding = string(s.str().length(), ' ');
   length = padding.length();
@@ -19,6 +19,8 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <vector>
 
 #include "bitboard.h"
 #include "bitcount.h"
@@ -27,6 +29,32 @@
 
 namespace {
 
+  // The shared pawn table is read and written by all the threads without any
+  // locking, so every slot keeps a checksum of the entry bytes. An entry that
+  // is read while being written, or written by two threads at once, will not
+  // match its checksum and is treated as a miss.
+
+  struct SharedSlot {
+    Pawns::Entry e;
+    Key check;
+  };
+
+  std::vector<SharedSlot> Shared;
+
+  Key checksum(const Pawns::Entry& e) {
+
+    const char* p = (const char*)&e;
+    Key c = 0, w;
+
+    for (size_t i = 0; i + sizeof(Key) <= sizeof(Pawns::Entry); i += sizeof(Key))
+    {
+        std::memcpy(&w, p + i, sizeof(Key));
+        c ^= (w << (i & 63)) | (w >> ((64 - i) & 63)); // Rotate to keep words apart
+    }
+
+    return c;
+  }
+
   #define V Value
   #define S(mg, eg) make_score(mg, eg)
 
@@ -204,15 +232,53 @@ Entry* probe(const Position& pos, Table& entries) {
   Key key = pos.pawn_key();
   Entry* e = entries[key];
 
+  entries.probes++;
+
   if (e->key == key)
+  {
+      entries.hits++;
       return e;
+  }
+
+  SharedSlot* slot = Shared.empty() ? NULL
+                   : &Shared[(uint64_t(uint32_t(key)) * Shared.size()) >> 32];
+
+  if (slot)
+  {
+      std::memcpy(e, &slot->e, sizeof(Entry));
+
+      if (e->key == key && checksum(*e) == slot->check)
+      {
+          entries.sharedHits++;
+          return e;
+      }
+  }
 
   e->key = key;
   e->value = evaluate<WHITE>(pos, e) - evaluate<BLACK>(pos, e);
+
+  if (slot)
+  {
+      std::memcpy(&slot->e, e, sizeof(Entry));
+      slot->check = checksum(*e);
+  }
+
   return e;
 }
 
 
+/// resize_shared() sets the size in KB of the pawn hash table shared by all
+/// the threads, zero means no shared table. Must not be called while searching.
+
+void resize_shared(size_t kbSize) {
+
+  size_t n = (kbSize << 10) / sizeof(SharedSlot);
+
+  if (n != Shared.size())
+      std::vector<SharedSlot>(n, SharedSlot()).swap(Shared);
+}
+
+
 /// Entry::shelter_storm() calculates shelter and storm penalties for the file
 /// the king is on, as well as the two adjacent files.
 
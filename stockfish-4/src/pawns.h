@@ -69,9 +69,18 @@ struct Entry {
   int pawnsOnSquares[COLOR_NB][COLOR_NB];
 };
 
-typedef HashTable<Entry, 16384> Table;
+/// Pawns::Table is the pawn hash table of a thread. It counts its probes and
+/// hits, either in the table itself or in the shared table, if any.
+
+struct Table : public HashTable<Entry> {
+
+  Table() : probes(0), hits(0), sharedHits(0) {}
+
+  uint64_t probes, hits, sharedHits;
+};
 
 Entry* probe(const Position& pos, Table& entries);
+void resize_shared(size_t kbSize);
 
 }
 
@@ -45,11 +45,32 @@ typedef unsigned __int64 uint64_t;
 #ifndef _WIN32 // Linux - Unix
 
 #  include <sys/time.h>
+#  include <time.h>
 
-inline int64_t system_time_to_msec() {
+// A steady clock, not affected by changes of the system time, in usec. Older
+// OS X has no clock_gettime(), there we fall back on gettimeofday().
+inline int64_t monotonic_time_to_usec() {
+#  if defined(__APPLE__)
   timeval t;
   gettimeofday(&t, NULL);
-  return t.tv_sec * 1000LL + t.tv_usec / 1000;
+  return t.tv_sec * 1000000LL + t.tv_usec;
+#  else
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+#  endif
+}
+
+// The same clock but read from the timestamp cached by the kernel at the last
+// tick, where available. Resolution is a few msec, but is cheaper to read.
+inline int64_t coarse_time_to_msec() {
+#  if defined(CLOCK_MONOTONIC_COARSE)
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &t);
+  return t.tv_sec * 1000LL + t.tv_nsec / 1000000;
+#  else
+  return monotonic_time_to_usec() / 1000;
+#  endif
 }
 
 #  include <pthread.h>
@@ -60,26 +81,34 @@ typedef void*(*pt_start_fn)(void*);
 
 #  define lock_init(x) pthread_mutex_init(&(x), NULL)
 #  define lock_grab(x) pthread_mutex_lock(&(x))
+#  define lock_try(x) (pthread_mutex_trylock(&(x)) == 0)
 #  define lock_release(x) pthread_mutex_unlock(&(x))
 #  define lock_destroy(x) pthread_mutex_destroy(&(x))
 #  define cond_destroy(x) pthread_cond_destroy(&(x))
-#  define cond_init(x) pthread_cond_init(&(x), NULL)
+#  if defined(__APPLE__) // No pthread_condattr_setclock()
+#    define cond_init(x) pthread_cond_init(&(x), NULL)
+#  else // Timed waits on the monotonic clock, immune to system time changes
+#    define cond_init(x) { pthread_condattr_t a; pthread_condattr_init(&a);       \
+                          pthread_condattr_setclock(&a, CLOCK_MONOTONIC);       \
+                          pthread_cond_init(&(x), &a); pthread_condattr_destroy(&a); }
+#  endif
 #  define cond_signal(x) pthread_cond_signal(&(x))
 #  define cond_wait(x,y) pthread_cond_wait(&(x),&(y))
 #  define cond_timedwait(x,y,z) pthread_cond_timedwait(&(x),&(y),z)
 #  define thread_create(x,f,t) pthread_create(&(x),NULL,(pt_start_fn)f,t)
 #  define thread_join(x) pthread_join(x, NULL)
+#  define atomic_cas(x,o,n) __sync_bool_compare_and_swap(&(x),o,n)
+#  define atomic_or(x,v) __sync_fetch_and_or(&(x),v)
+#  define atomic_and(x,v) __sync_fetch_and_and(&(x),v)
+#  define memory_barrier() __sync_synchronize()
+#  if defined(__i386__) || defined(__x86_64__)
+#    define cpu_pause() __asm__ __volatile__("pause")
+#  else
+#    define cpu_pause()
+#  endif
 
 #else // Windows and MinGW
 
-#  include <sys/timeb.h>
-
-inline int64_t system_time_to_msec() {
-  _timeb t;
-  _ftime(&t);
-  return t.time * 1000LL + t.millitm;
-}
-
 #ifndef NOMINMAX
 #  define NOMINMAX // disable macros min() and max()
 #endif
@@ -101,6 +130,7 @@ inline DWORD* dwWin9xKludge() { static DWORD dw; return &dw; }
 
 #  define lock_init(x) InitializeCriticalSection(&(x))
 #  define lock_grab(x) EnterCriticalSection(&(x))
+#  define lock_try(x) (TryEnterCriticalSection(&(x)) != 0)
 #  define lock_release(x) LeaveCriticalSection(&(x))
 #  define lock_destroy(x) DeleteCriticalSection(&(x))
 #  define cond_init(x) { x = CreateEvent(0, FALSE, FALSE, 0); }
@@ -110,6 +140,24 @@ inline DWORD* dwWin9xKludge() { static DWORD dw; return &dw; }
 #  define cond_timedwait(x,y,z) { lock_release(y); WaitForSingleObject(x,z); lock_grab(y); }
 #  define thread_create(x,f,t) (x = CreateThread(NULL,0,(LPTHREAD_START_ROUTINE)f,t,0,dwWin9xKludge()))
 #  define thread_join(x) { WaitForSingleObject(x, INFINITE); CloseHandle(x); }
+#  define atomic_cas(x,o,n) (InterlockedCompareExchange(&(x),n,o) == (o))
+#  define atomic_or(x,v) InterlockedOr64((volatile LONGLONG*)&(x),v)
+#  define atomic_and(x,v) InterlockedAnd64((volatile LONGLONG*)&(x),v)
+#  define memory_barrier() MemoryBarrier()
+#  define cpu_pause() YieldProcessor()
+
+// The performance counter is steady, split the conversion to avoid overflows
+inline int64_t monotonic_time_to_usec() {
+  static LARGE_INTEGER f;
+  LARGE_INTEGER t;
+  if (!f.QuadPart)
+      QueryPerformanceFrequency(&f);
+  QueryPerformanceCounter(&t);
+  return  t.QuadPart / f.QuadPart * 1000000LL
+        + t.QuadPart % f.QuadPart * 1000000LL / f.QuadPart;
+}
+
+inline int64_t coarse_time_to_msec() { return monotonic_time_to_usec() / 1000; }
 
 #endif
 
@@ -166,7 +166,6 @@ Position& Position::operator=(const Position& pos) {
   std::memcpy(this, &pos, sizeof(Position));
   startState = *st;
   st = &startState;
-  nodes = 0;
 
   assert(pos_is_ok());
 
@@ -293,6 +292,9 @@ void Position::set(const string& fenStr, bool isChess960, Thread* th) {
   st->npMaterial[WHITE] = compute_non_pawn_material(WHITE);
   st->npMaterial[BLACK] = compute_non_pawn_material(BLACK);
   st->checkersBB = attackers_to(king_square(sideToMove)) & pieces(~sideToMove);
+#if defined(ATTACK_MAPS)
+  update_attacks(pieces(), ~0);
+#endif
   chess960 = isChess960;
   thisThread = th;
 
@@ -718,7 +720,7 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
   assert(is_ok(m));
   assert(&newSt != st);
 
-  nodes++;
+  thisThread->nodes++;
   Key k = st->key;
 
   // Copy some fields of old state to our new StateInfo object except the ones
@@ -750,6 +752,11 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
   assert(piece_on(to) == NO_PIECE || color_of(piece_on(to)) == them || type_of(m) == CASTLE);
   assert(capture != KING);
 
+#if defined(ATTACK_MAPS)
+  Bitboard changed = changed_squares(m);
+  int owners = owners_of(changed);
+#endif
+
   if (type_of(m) == CASTLE)
   {
       assert(pc == make_piece(us, KING));
@@ -908,6 +915,10 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
       }
   }
 
+#if defined(ATTACK_MAPS)
+  update_attacks(changed, owners);
+#endif
+
   sideToMove = ~sideToMove;
 
   assert(pos_is_ok());
@@ -933,6 +944,11 @@ void Position::undo_move(Move m) {
   assert(is_empty(from) || type_of(m) == CASTLE);
   assert(capture != KING);
 
+#if defined(ATTACK_MAPS)
+  Bitboard changed = changed_squares(m);
+  int owners = owners_of(changed);
+#endif
+
   if (type_of(m) == PROMOTION)
   {
       PieceType promotion = promotion_type(m);
@@ -976,6 +992,10 @@ void Position::undo_move(Move m) {
       put_piece(capsq, them, capture); // Restore the captured piece
   }
 
+#if defined(ATTACK_MAPS)
+  update_attacks(changed, owners);
+#endif
+
   // Finally point our state pointer back to the previous state
   st = st->previous;
   gamePly--;
@@ -998,6 +1018,107 @@ void Position::do_castle(Square kfrom, Square kto, Square rfrom, Square rto) {
 }
 
 
+#if defined(ATTACK_MAPS)
+
+/// Position::changed_squares() returns the squares whose content is changed by
+/// move m of the side to move: the from and to squares, plus the square of the
+/// pawn captured en passant or the destination squares of a castle.
+
+Bitboard Position::changed_squares(Move m) const {
+
+  Square from = from_sq(m);
+  Square to = to_sq(m);
+  Bitboard b = SquareBB[from] | SquareBB[to];
+
+  if (type_of(m) == ENPASSANT)
+      b |= to - pawn_push(sideToMove);
+
+  else if (type_of(m) == CASTLE)
+  {
+      bool kingSide = to > from;
+      b |= relative_square(sideToMove, kingSide ? SQ_G1 : SQ_C1);
+      b |= relative_square(sideToMove, kingSide ? SQ_F1 : SQ_D1);
+  }
+
+  return b;
+}
+
+
+/// Position::owners_of() returns a bitmask, indexed by Piece, of the pieces
+/// standing on the given squares.
+
+int Position::owners_of(Bitboard b) const {
+
+  int owners = 0;
+
+  while (b)
+      owners |= 1 << board[pop_lsb(&b)];
+
+  return owners;
+}
+
+
+/// Position::update_attacks() updates the attack maps once the content of the
+/// 'changed' squares has been modified. Apart from the pieces standing on them
+/// only the sliders attacking one of these squares, whose rays cross it, can
+/// see their attacks change. Then the union of attacks by color and piece type
+/// is rebuilt for the pieces whose attacks have changed and for the ones in
+/// 'owners', that were on the changed squares before the move.
+
+void Position::update_attacks(Bitboard changed, int owners) {
+
+  Bitboard b = (pieces(BISHOP, ROOK) | pieces(QUEEN)) & ~changed;
+
+  while (b)
+  {
+      Square s = pop_lsb(&b);
+
+      if (attacksBB[s] & changed)
+      {
+          attacksBB[s] = attacks_from(board[s], s);
+          owners |= 1 << board[s];
+      }
+  }
+
+  b = changed;
+
+  while (b)
+  {
+      Square s = pop_lsb(&b);
+      attacksBB[s] = board[s] != NO_PIECE ? attacks_from(board[s], s) : 0;
+      owners |= 1 << board[s];
+  }
+
+  for (Color c = WHITE; c <= BLACK; c++)
+  {
+      if (!(owners & (0x7E << (8 * c))))
+          continue;
+
+      // Pawn attacks are just a shift of the pawns bitboard
+      if (owners & (1 << make_piece(c, PAWN)))
+          attacksByBB[c][PAWN] = c == WHITE ? shift_bb<DELTA_NE>(pieces(c, PAWN)) | shift_bb<DELTA_NW>(pieces(c, PAWN))
+                                            : shift_bb<DELTA_SE>(pieces(c, PAWN)) | shift_bb<DELTA_SW>(pieces(c, PAWN));
+
+      for (PieceType pt = KNIGHT; pt <= KING; pt++)
+          if (owners & (1 << make_piece(c, pt)))
+          {
+              Bitboard a = 0;
+
+              for (int i = 0; i < pieceCount[c][pt]; i++)
+                  a |= attacksBB[pieceList[c][pt][i]];
+
+              attacksByBB[c][pt] = a;
+          }
+
+      attacksByBB[c][ALL_PIECES] =  attacksByBB[c][PAWN]   | attacksByBB[c][KNIGHT]
+                                  | attacksByBB[c][BISHOP] | attacksByBB[c][ROOK]
+                                  | attacksByBB[c][QUEEN]  | attacksByBB[c][KING];
+  }
+}
+
+#endif
+
+
 /// Position::do(undo)_null_move() is used to do(undo) a "null move": It flips
 /// the side to move without executing any move on the board.
 
@@ -1083,6 +1204,14 @@ int Position::see(Move m, int asymmThreshold) const {
       swapList[0] = PieceValue[MG][PAWN];
   }
 
+#if defined(ATTACK_MAPS)
+  // The attack maps tell at once if the opponent cannot recapture, neither
+  // directly nor with a slider X-raying through the moving piece.
+  else if (   !(attacks_by(~stm) & to)
+           && !((attacks_by(~stm, BISHOP) | attacks_by(~stm, ROOK) | attacks_by(~stm, QUEEN)) & from))
+      return swapList[0];
+#endif
+
   // Find all attackers to the destination square, with the moving piece
   // removed, but possibly an X-ray attacker added behind it.
   attackers = attackers_to(to, occupied) & occupied;
@@ -1350,6 +1479,9 @@ bool Position::pos_is_ok(int* failedStep) const {
   const bool debugPieceCounts     = all || false;
   const bool debugPieceList       = all || false;
   const bool debugCastleSquares   = all || false;
+#if defined(ATTACK_MAPS)
+  const bool debugAttackMaps      = all || false;
+#endif
 
   *step = 1;
 
@@ -1448,6 +1580,30 @@ bool Position::pos_is_ok(int* failedStep) const {
                   return false;
           }
 
+#if defined(ATTACK_MAPS)
+  if ((*step)++, debugAttackMaps)
+  {
+      Bitboard byType[COLOR_NB][PIECE_TYPE_NB] = {};
+
+      for (Square s = SQ_A1; s <= SQ_H8; s++)
+      {
+          if (attacksBB[s] != (is_empty(s) ? 0 : attacks_from(piece_on(s), s)))
+              return false;
+
+          if (!is_empty(s))
+          {
+              byType[color_of(piece_on(s))][type_of(piece_on(s))] |= attacksBB[s];
+              byType[color_of(piece_on(s))][ALL_PIECES] |= attacksBB[s];
+          }
+      }
+
+      for (Color c = WHITE; c <= BLACK; c++)
+          for (PieceType pt = ALL_PIECES; pt <= KING; pt++)
+              if (attacksByBB[c][pt] != byType[c][pt])
+                  return false;
+  }
+#endif
+
   *step = 0;
   return true;
 }
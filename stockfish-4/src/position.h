@@ -88,6 +88,8 @@ const size_t StateCopySize64 = offsetof(StateInfo, key) / sizeof(uint64_t) + 1;
 ///    * Hash keys for all previous positions in the game for detecting
 ///      repetition draws.
 ///    * A counter for detecting 50 move rule draws.
+///    * With ATTACK_MAPS, the attacks of the piece on each square and their
+///      union by color and piece type, updated incrementally by do_move().
 
 class Position {
 public:
@@ -134,6 +136,10 @@ public:
   static Bitboard attacks_from(Piece p, Square s, Bitboard occ);
   template<PieceType> Bitboard attacks_from(Square s) const;
   template<PieceType> Bitboard attacks_from(Square s, Color c) const;
+#if defined(ATTACK_MAPS)
+  Bitboard attacks_of(Square s) const;
+  Bitboard attacks_by(Color c, PieceType pt = ALL_PIECES) const;
+#endif
 
   // Properties of moves
   bool move_gives_check(Move m, const CheckInfo& ci) const;
@@ -177,8 +183,6 @@ public:
   int game_ply() const;
   bool is_chess960() const;
   Thread* this_thread() const;
-  int64_t nodes_searched() const;
-  void set_nodes_searched(int64_t n);
   bool is_draw() const;
 
   // Position consistency check, for debugging
@@ -196,6 +200,11 @@ private:
   void put_piece(Square s, Color c, PieceType pt);
   void remove_piece(Square s, Color c, PieceType pt);
   void move_piece(Square from, Square to, Color c, PieceType pt);
+#if defined(ATTACK_MAPS)
+  Bitboard changed_squares(Move m) const;
+  int owners_of(Bitboard b) const;
+  void update_attacks(Bitboard changed, int owners);
+#endif
 
   // Computing hash keys from scratch (for initialization and debugging)
   Key compute_key() const;
@@ -213,13 +222,16 @@ private:
   int pieceCount[COLOR_NB][PIECE_TYPE_NB];
   Square pieceList[COLOR_NB][PIECE_TYPE_NB][16];
   int index[SQUARE_NB];
+#if defined(ATTACK_MAPS)
+  Bitboard attacksBB[SQUARE_NB];
+  Bitboard attacksByBB[COLOR_NB][PIECE_TYPE_NB];
+#endif
 
   // Other info
   int castleRightsMask[SQUARE_NB];
   Square castleRookSquare[COLOR_NB][CASTLING_SIDE_NB];
   Bitboard castlePath[COLOR_NB][CASTLING_SIDE_NB];
   StateInfo startState;
-  int64_t nodes;
   int gamePly;
   Color sideToMove;
   Thread* thisThread;
@@ -227,14 +239,6 @@ private:
   int chess960;
 };
 
-inline int64_t Position::nodes_searched() const {
-  return nodes;
-}
-
-inline void Position::set_nodes_searched(int64_t n) {
-  nodes = n;
-}
-
 inline Piece Position::piece_on(Square s) const {
   return board[s];
 }
@@ -324,6 +328,16 @@ inline Bitboard Position::attacks_from(Piece p, Square s) const {
   return attacks_from(p, s, byTypeBB[ALL_PIECES]);
 }
 
+#if defined(ATTACK_MAPS)
+inline Bitboard Position::attacks_of(Square s) const {
+  return attacksBB[s];
+}
+
+inline Bitboard Position::attacks_by(Color c, PieceType pt) const {
+  return attacksByBB[c][pt];
+}
+#endif
+
 inline Bitboard Position::attackers_to(Square s) const {
   return attackers_to(s, byTypeBB[ALL_PIECES]);
 }
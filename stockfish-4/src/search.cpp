@@ -55,8 +55,13 @@ namespace {
   // Set to true to force running with one thread. Used for debugging
   const bool FakeSplit = false;
 
-  // This is the minimum interval in msec between two check_time() calls
+  // This is the interval in msec between two check_time() calls when there is
+  // no time limit due before, or when we are just past the optimum time.
   const int TimerResolution = 5;
+  const int DebugInfoInterval = 1000;
+
+  // Each thread checks the node and time limits every this many own nodes
+  const int LimitsCheckInterval = 1024;
 
   // Different node types, used as template parameter
   enum NodeType { Root, PV, NonPV, SplitPointRoot, SplitPointPV, SplitPointNonPV };
@@ -86,9 +91,23 @@ namespace {
   TimeManager TimeMgr;
   int BestMoveChanges;
   Value DrawValue[COLOR_NB];
-  HistoryStats History;
-  GainsStats Gains;
-  CountermovesStats Countermoves;
+
+  // check_limits() stops the search when the node limit is reached or the
+  // deadline has passed. Each node is entered just after its move has been
+  // counted, so checking on multiples of LimitsCheckInterval the thread sums
+  // the counters and reads the clock once every that many of its own nodes,
+  // without taking any lock. The time check backs up the timer thread, that
+  // can be late to run when the searching threads keep all the CPUs busy.
+  inline void check_limits(const Thread* thisThread) {
+
+    if (thisThread->nodes % LimitsCheckInterval)
+        return;
+
+    if (   (Limits.nodes && nodes_searched() >= Limits.nodes)
+        || (   TimeMgr.deadline() && !Limits.ponder
+            && Time::coarse_now() - SearchTime >= TimeMgr.deadline()))
+        Signals.stop = true;
+  }
 
   template <NodeType NT>
   Value search(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth, bool cutNode);
@@ -97,6 +116,8 @@ namespace {
   Value qsearch(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth);
 
   void id_loop(Position& pos);
+  void helper_id_loop(Position& pos);
+  void stop_helpers();
   Value value_to_tt(Value v, int ply);
   Value value_from_tt(Value v, int ply);
   bool check_is_dangerous(const Position& pos, Move move, Value futilityBase, Value beta);
@@ -159,29 +180,165 @@ void Search::init() {
 }
 
 
+namespace {
+
+  // The perft hash stores the leaf count of a position at a given depth. It is
+  // written by many threads without locking, so the key is XOR-ed with the
+  // count and a torn entry is seen as a miss.
+  struct PerftEntry {
+    Key keyXorCount;
+    uint64_t count;
+  };
+
+  PerftEntry* PerftTable;
+  size_t PerftTableSize;
+
+  PerftEntry* perft_entry(Key k) {
+    return &PerftTable[(uint64_t(uint32_t(k)) * PerftTableSize) >> 32];
+  }
+
+  // perft() counts the leaf nodes up to the given depth, greater than one ply.
+  // Subtrees of three plies or more are cached in the perft hash.
+
+  size_t perft(Position& pos, Depth depth) {
+
+    StateInfo st;
+    size_t cnt = 0;
+    const bool leaf = depth == 2 * ONE_PLY;
+    Key k = pos.key() ^ (Key(depth) * 0x9E3779B97F4A7C15ULL);
+    PerftEntry* e = leaf || !PerftTable ? NULL : perft_entry(k);
+
+    if (e)
+    {
+        PerftEntry snapshot = *e;
+
+        if ((snapshot.keyXorCount ^ snapshot.count) == k)
+            return size_t(snapshot.count);
+    }
+
+    CheckInfo ci(pos);
+
+    for (MoveList<LEGAL> it(pos); *it; ++it)
+    {
+        pos.do_move(*it, st, ci, pos.move_gives_check(*it, ci));
+        cnt += leaf ? MoveList<LEGAL>(pos).size() : perft(pos, depth - ONE_PLY);
+        pos.undo_move(*it);
+    }
+
+    if (e)
+    {
+        e->count = cnt;
+        e->keyXorCount = k ^ cnt;
+    }
+
+    return cnt;
+  }
+
+  // A PerftTask hands out the root moves one at a time to the threads of the
+  // pool, each one counting the leaves of the move on its own copy of the
+  // root position.
+
+  struct PerftTask : public ThreadTask {
+
+    void run(Thread* th) {
+
+      Position pos(*rootPos, th);
+      StateInfo st;
+
+      while (true)
+      {
+          mutex.lock();
+          size_t i = next++;
+          mutex.unlock();
+
+          if (i >= moves.size())
+              return;
+
+          pos.do_move(moves[i], st);
+          counts[i] =  depth > 2 * ONE_PLY ? perft(pos, depth - ONE_PLY)
+                     : depth > ONE_PLY     ? MoveList<LEGAL>(pos).size() : 1;
+          pos.undo_move(moves[i]);
+      }
+    }
+
+    const Position* rootPos;
+    std::vector<Move> moves;
+    std::vector<size_t> counts;
+    Depth depth;
+    Mutex mutex;
+    size_t next;
+  };
+
+} // namespace
+
+
 /// Search::perft() is our utility to verify move generation. All the leaf nodes
-/// up to the given depth are generated and counted and the sum returned.
+/// up to the given depth are generated and counted and the sum returned. Root
+/// moves are shared among the threads of the pool, with a perft hash as big as
+/// the transposition table allocated for the call. With 'divide' the count of
+/// each root move is printed too.
 
-static size_t perft(Position& pos, Depth depth) {
+size_t Search::perft(Position& pos, Depth depth, bool divide) {
 
-  StateInfo st;
+  PerftTask task;
   size_t cnt = 0;
-  CheckInfo ci(pos);
-  const bool leaf = depth == 2 * ONE_PLY;
 
   for (MoveList<LEGAL> it(pos); *it; ++it)
+      task.moves.push_back(*it);
+
+  task.rootPos = &pos;
+  task.counts.resize(task.moves.size());
+  task.depth = depth;
+  task.next = 0;
+
+  // Big blocks from calloc() are fresh zero pages, untouched ones cost nothing
+  if (depth > 3 * ONE_PLY)
+  {
+      PerftTableSize = (UCI::hash_kb() << 10) / sizeof(PerftEntry);
+      PerftTable = (PerftEntry*)calloc(PerftTableSize, sizeof(PerftEntry));
+  }
+
+  Threads.run(task, std::min(Threads.size(), std::max(task.moves.size(), size_t(1))));
+
+  free(PerftTable);
+  PerftTable = NULL;
+
+  for (size_t i = 0; i < task.moves.size(); i++)
   {
-      pos.do_move(*it, st, ci, pos.move_gives_check(*it, ci));
-      cnt += leaf ? MoveList<LEGAL>(pos).size() : ::perft(pos, depth - ONE_PLY);
-      pos.undo_move(*it);
+      cnt += task.counts[i];
+
+      if (divide)
+          sync_cout << move_to_uci(task.moves[i], pos.is_chess960())
+                    << ": " << task.counts[i] << sync_endl;
   }
+
   return cnt;
 }
 
-size_t Search::perft(Position& pos, Depth depth) {
-  return depth > ONE_PLY ? ::perft(pos, depth) : MoveList<LEGAL>(pos).size();
+
+/// Search::nodes_searched() returns the nodes searched so far by all the
+/// threads. Each thread counts its own nodes, so no lock is needed to sum them.
+
+int64_t Search::nodes_searched() {
+
+  int64_t nodes = 0;
+
+  for (size_t i = 0; i < Threads.size(); i++)
+      nodes += Threads[i]->nodes;
+
+  return nodes;
+}
+
+
+/// Search::new_game() is called when the GUI sends "ucinewgame", to reset what
+/// is kept from one move to the next of a game: the overshoot statistics.
+
+void Search::new_game() {
+
+  TimeMgr.clear_stats();
 }
 
+
 /// Search::think() is the external interface to Stockfish's search, and is
 /// called by the main thread when the program receives the UCI 'go' command. It
 /// searches from RootPos and at the end prints the "bestmove" to output.
@@ -193,6 +350,19 @@ void Search::think() {
   RootColor = RootPos.side_to_move();
   TimeMgr.init(Limits, RootPos.game_ply(), RootColor);
 
+  RootPos.this_thread()->completedDepth = 0;
+  RootPos.this_thread()->completedScore = -VALUE_INFINITE;
+
+  // In Lazy SMP mode each helper thread gets its own copy of the root position
+  // and moves, the search is started by id_loop() once the tables are reset.
+  if (Threads.lazySMP)
+      for (size_t i = 1; i < Threads.size(); i++)
+      {
+          Threads[i]->rootPos = Position(RootPos, Threads[i]);
+          Threads[i]->rootMoves = RootMoves;
+          Threads[i]->completedDepth = 0;
+      }
+
   if (RootMoves.empty())
   {
       RootMoves.push_back(MOVE_NONE);
@@ -242,18 +412,14 @@ void Search::think() {
 
   Threads.sleepWhileIdle = Options["Idle Threads Sleep"];
 
-  // Set best timer interval to avoid lagging under time pressure. Timer is
-  // used to check for remaining available thinking time.
-  Threads.timer->msec =
-  Limits.use_time_management() ? std::min(100, std::max(TimeMgr.available_time() / 16, TimerResolution)) :
-                  Limits.nodes ? 2 * TimerResolution
-                               : 100;
-
-  Threads.timer->notify_one(); // Wake up the recurring timer
+  // Wake up the timer, it sleeps until the next time limit is due and then
+  // checks the remaining available thinking time.
+  Threads.timer->run = true;
+  Threads.timer->notify_one();
 
   id_loop(RootPos); // Let's start searching !
 
-  Threads.timer->msec = 0; // Stop the timer
+  Threads.timer->run = false; // Stop the timer
   Threads.sleepWhileIdle = true; // Send idle threads to sleep
 
   if (Options["Write Search Log"])
@@ -261,8 +427,8 @@ void Search::think() {
       Time::point elapsed = Time::now() - SearchTime + 1;
 
       Log log(Options["Search Log Filename"]);
-      log << "Nodes: "          << RootPos.nodes_searched()
-          << "\nNodes/second: " << RootPos.nodes_searched() * 1000 / elapsed
+      log << "Nodes: "          << nodes_searched()
+          << "\nNodes/second: " << nodes_searched() * 1000 / elapsed
           << "\nBest move: "    << move_to_san(RootPos, RootMoves[0].pv[0]);
 
       StateInfo st;
@@ -274,7 +440,7 @@ void Search::think() {
 finalize:
 
   // When search is stopped this info is not printed
-  sync_cout << "info nodes " << RootPos.nodes_searched()
+  sync_cout << "info nodes " << nodes_searched()
             << " time " << Time::now() - SearchTime + 1 << sync_endl;
 
   // When we reach max depth we arrive here even without Signals.stop is raised,
@@ -288,6 +454,33 @@ finalize:
       RootPos.this_thread()->wait_for(Signals.stop);
   }
 
+  if (Threads.lazySMP)
+      stop_helpers();
+
+  // Report how far from the deadline we move, to tune the time management
+  if (TimeMgr.deadline() && !Limits.ponder)
+  {
+      int64_t overshoot = Time::now() - SearchTime - TimeMgr.deadline();
+      TimeMgr.record_overshoot(overshoot);
+
+      const TimeManager::Stats& st = TimeMgr.overshoot_stats();
+      std::ostringstream ss;
+      ss << "Deadline "       << TimeMgr.deadline()
+         << " ms, overshoot " << overshoot
+         << " ms (average "   << st.overshootSum / st.moves
+         << ", max over "     << st.maxOvershoot
+         << ", max under "    << st.maxUndershoot
+         << " in "            << st.moves << " moves)";
+
+      sync_cout << "info string " << ss.str() << sync_endl;
+
+      if (Options["Write Search Log"])
+      {
+          Log log(Options["Search Log Filename"]);
+          log << ss.str() << std::endl;
+      }
+  }
+
   // Best move could be MOVE_NONE when searching on a stalemate position
   sync_cout << "bestmove " << move_to_uci(RootMoves[0].pv[0], RootPos.is_chess960())
             << " ponder "  << move_to_uci(RootMoves[0].pv[1], RootPos.is_chess960())
@@ -315,9 +508,12 @@ namespace {
     beta = VALUE_INFINITE;
 
     TT.new_search();
-    History.clear();
-    Gains.clear();
-    Countermoves.clear();
+
+    for (size_t i = 0; i < Threads.size(); i++)
+    {
+        Threads[i]->ownStats.clear();
+        Threads[i]->evalTable.clear();
+    }
 
     PVSize = Options["MultiPV"];
     Skill skill(Options["Skill Level"]);
@@ -329,6 +525,13 @@ namespace {
 
     PVSize = std::min(PVSize, RootMoves.size());
 
+    if (Threads.lazySMP)
+        for (size_t i = 1; i < Threads.size(); i++)
+        {
+            Threads[i]->searching = true; // Leaves idle_loop()
+            Threads[i]->notify_one();
+        }
+
     // Iterative deepening loop until requested to stop or target depth reached
     while (++depth <= MAX_PLY && !Signals.stop && (!Limits.depth || depth <= Limits.depth))
     {
@@ -379,7 +582,7 @@ namespace {
                 // When failing high/low give some update (without cluttering
                 // the UI) before to research.
                 if (  (bestValue <= alpha || bestValue >= beta)
-                    && Time::now() - SearchTime > 3000)
+                    && Time::coarse_now() - SearchTime > 3000)
                     sync_cout << uci_pv(pos, depth, alpha, beta) << sync_endl;
 
                 // In case of failing low/high increase aspiration window and
@@ -409,6 +612,10 @@ namespace {
                 sync_cout << uci_pv(pos, depth, alpha, beta) << sync_endl;
         }
 
+        pos.this_thread()->completedDepth = depth;
+        pos.this_thread()->completedScore = RootMoves[0].score;
+        pos.this_thread()->completedPv = RootMoves[0].pv;
+
         // Do we need to pick now the sub-optimal best move ?
         if (skill.enabled() && skill.time_to_pick(depth))
             skill.pick_move();
@@ -478,6 +685,113 @@ namespace {
   }
 
 
+  // helper_id_loop() is the iterative deepening loop of the helper threads in
+  // Lazy SMP mode. Helpers share only the transposition table with the main
+  // thread, to search different parts of the tree they skip some depths, so
+  // that about half of them is always one ply ahead of the main thread, and
+  // start with a differently ordered root move list. Helpers don't report to
+  // the GUI and don't manage time, they run until Signals.stop is raised.
+
+  void helper_id_loop(Position& pos) {
+
+    const int SkipSize[]  = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+    const int SkipPhase[] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+    Stack stack[MAX_PLY_PLUS_6], *ss = stack+2; // To allow referencing (ss-2)
+    Thread* thisThread = pos.this_thread();
+    std::vector<RootMove>& rootMoves = thisThread->rootMoves;
+    int depth = 0, i = (thisThread->idx - 1) % 20;
+    Value bestValue, alpha, beta, delta;
+
+    std::memset(ss-2, 0, 5 * sizeof(Stack));
+    (ss-1)->currentMove = MOVE_NULL; // Hack to skip update gains
+
+    if (rootMoves.size() > 1)
+        std::rotate(rootMoves.begin(),
+                    rootMoves.begin() + thisThread->idx % rootMoves.size(),
+                    rootMoves.end());
+
+    while (++depth <= MAX_PLY && !Signals.stop)
+    {
+        if (((depth + SkipPhase[i]) / SkipSize[i]) % 2)
+            continue;
+
+        for (size_t j = 0; j < rootMoves.size(); j++)
+            rootMoves[j].prevScore = rootMoves[j].score;
+
+        delta = Value(16);
+        alpha = depth >= 5 ? std::max(rootMoves[0].prevScore - delta,-VALUE_INFINITE) : -VALUE_INFINITE;
+        beta  = depth >= 5 ? std::min(rootMoves[0].prevScore + delta, VALUE_INFINITE) :  VALUE_INFINITE;
+
+        while (true)
+        {
+            bestValue = search<Root>(pos, ss, alpha, beta, depth * ONE_PLY, false);
+
+            std::stable_sort(rootMoves.begin(), rootMoves.end());
+
+            if (Signals.stop)
+                return;
+
+            if (bestValue <= alpha)
+                alpha = std::max(bestValue - delta, -VALUE_INFINITE);
+
+            else if (bestValue >= beta)
+                beta = std::min(bestValue + delta, VALUE_INFINITE);
+
+            else
+                break;
+
+            delta += delta / 2;
+        }
+
+        thisThread->completedDepth = depth;
+        thisThread->completedScore = rootMoves[0].score;
+        thisThread->completedPv = rootMoves[0].pv;
+    }
+  }
+
+
+  // stop_helpers() stops the Lazy SMP helper threads and waits for them to go
+  // back to idle. Then, if a helper has completed a deeper iteration than the
+  // main thread with a better score, its best move and PV are played instead.
+  // Only the results of completed iterations are compared, the root moves of
+  // an aborted one can be sorted by fail high bounds.
+
+  void stop_helpers() {
+
+    MainThread* mainThread = Threads.main();
+    Thread* best = mainThread;
+
+    Signals.stop = true;
+
+    for (size_t i = 1; i < Threads.size(); i++)
+    {
+        Thread* th = Threads[i];
+
+        mainThread->mutex.lock();
+        while (th->searching)
+            mainThread->sleepCondition.wait(mainThread->mutex);
+        mainThread->mutex.unlock();
+
+        if (   th->completedDepth > best->completedDepth
+            && th->completedScore > best->completedScore)
+            best = th;
+    }
+
+    // Not with MultiPV, that is enabled also by Skill Level
+    if (best == mainThread || PVSize != 1)
+        return;
+
+    RootMove& rm = *std::find(RootMoves.begin(), RootMoves.end(), best->completedPv[0]);
+    rm.score = best->completedScore;
+    rm.pv = best->completedPv;
+    std::swap(RootMoves[0], rm);
+    PVIdx = 0;
+
+    sync_cout << uci_pv(RootPos, best->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
+  }
+
+
   // search<>() is the main search function for both PV and non-PV nodes and for
   // normal and SplitPoint nodes. When called just after a split point the search
   // is simpler because we have already probed the hash table, done a null move
@@ -498,6 +812,7 @@ namespace {
 
     Move quietsSearched[64];
     StateInfo st;
+    TTEntry ttEntry;
     const TTEntry *tte;
     SplitPoint* splitPoint;
     Key posKey;
@@ -513,6 +828,12 @@ namespace {
     Thread* thisThread = pos.this_thread();
     inCheck = pos.checkers();
 
+    // Lazy SMP helper threads search their own root moves, as a single PV
+    const bool helper = RootNode && Threads.lazySMP && thisThread != Threads.main();
+    std::vector<RootMove>& rootMoves = helper ? thisThread->rootMoves : RootMoves;
+    const size_t pvIdx = helper ? 0 : PVIdx;
+    MoveStats& stats = *thisThread->stats;
+
     if (SpNode)
     {
         splitPoint = ss->splitPoint;
@@ -542,6 +863,8 @@ namespace {
 
     if (!RootNode)
     {
+        check_limits(thisThread);
+
         // Step 2. Check for aborted search and immediate draw
         if (Signals.stop || pos.is_draw() || ss->ply > MAX_PLY)
             return DrawValue[pos.side_to_move()];
@@ -563,8 +886,8 @@ namespace {
     // TT value, so we use a different position key in case of an excluded move.
     excludedMove = ss->excludedMove;
     posKey = excludedMove ? pos.exclusion_key() : pos.key();
-    tte = TT.probe(posKey);
-    ttMove = RootNode ? RootMoves[PVIdx].pv[0] : tte ? tte->move() : MOVE_NONE;
+    tte = TT.probe(posKey, ttEntry);
+    ttMove = RootNode ? rootMoves[pvIdx].pv[0] : tte ? tte->move() : MOVE_NONE;
     ttValue = tte ? value_from_tt(tte->value(), ss->ply) : VALUE_NONE;
 
     // At PV nodes we check for exact scores, while at non-PV nodes we check for
@@ -579,8 +902,11 @@ namespace {
             : ttValue >= beta ? (tte->bound() &  BOUND_LOWER)
                               : (tte->bound() &  BOUND_UPPER)))
     {
-        TT.refresh(tte);
-        ss->currentMove = ttMove; // Can be MOVE_NONE
+        TT.refresh(posKey);
+
+        // On a key collision ttMove could be invalid, and parent would
+        // read it as the threat move.
+        ss->currentMove = ttMove && pos.is_pseudo_legal(ttMove) ? ttMove : MOVE_NONE;
 
         if (    ttValue >= beta
             &&  ttMove
@@ -614,11 +940,7 @@ namespace {
                 eval = ttValue;
     }
     else
-    {
         eval = ss->staticEval = evaluate(pos, ss->evalMargin);
-        TT.store(posKey, VALUE_NONE, BOUND_NONE, DEPTH_NONE, MOVE_NONE,
-                 ss->staticEval, ss->evalMargin);
-    }
 
     // Update gain for the parent non-capture move given the static position
     // evaluation before and after the move.
@@ -629,7 +951,7 @@ namespace {
         &&  type_of(move) == NORMAL)
     {
         Square to = to_sq(move);
-        Gains.update(pos.piece_on(to), to, -(ss-1)->staticEval - ss->staticEval);
+        stats.gains.update(pos.piece_on(to), to, -(ss-1)->staticEval - ss->staticEval);
     }
 
     // Step 6. Razoring (skipped when in check)
@@ -735,7 +1057,7 @@ namespace {
         assert((ss-1)->currentMove != MOVE_NONE);
         assert((ss-1)->currentMove != MOVE_NULL);
 
-        MovePicker mp(pos, ttMove, History, pos.captured_piece_type());
+        MovePicker mp(pos, ttMove, pos.captured_piece_type());
         CheckInfo ci(pos);
 
         while ((move = mp.next_move<false>()) != MOVE_NONE)
@@ -761,17 +1083,17 @@ namespace {
         search<PvNode ? PV : NonPV>(pos, ss, alpha, beta, d, true);
         ss->skipNullMove = false;
 
-        tte = TT.probe(posKey);
+        tte = TT.probe(posKey, ttEntry);
         ttMove = tte ? tte->move() : MOVE_NONE;
     }
 
 moves_loop: // When in check and at SpNode search starts from here
 
     Square prevMoveSq = to_sq((ss-1)->currentMove);
-    Move countermoves[] = { Countermoves[pos.piece_on(prevMoveSq)][prevMoveSq].first,
-                            Countermoves[pos.piece_on(prevMoveSq)][prevMoveSq].second };
+    Move countermoves[] = { stats.countermoves[pos.piece_on(prevMoveSq)][prevMoveSq].first,
+                            stats.countermoves[pos.piece_on(prevMoveSq)][prevMoveSq].second };
 
-    MovePicker mp(pos, ttMove, depth, History, countermoves, ss);
+    MovePicker mp(pos, ttMove, depth, countermoves, ss);
     CheckInfo ci(pos);
     value = bestValue; // Workaround a bogus 'uninitialized' warning under gcc
     improving =   ss->staticEval >= (ss-2)->staticEval
@@ -798,7 +1120,7 @@ moves_loop: // When in check and at SpNode search starts from here
       // At root obey the "searchmoves" option and skip moves not listed in Root
       // Move List, as a consequence any illegal move is also skipped. In MultiPV
       // mode we also skip PV moves which have been already searched.
-      if (RootNode && !std::count(RootMoves.begin() + PVIdx, RootMoves.end(), move))
+      if (RootNode && !std::count(rootMoves.begin() + pvIdx, rootMoves.end(), move))
           continue;
 
       if (SpNode)
@@ -813,11 +1135,11 @@ moves_loop: // When in check and at SpNode search starts from here
       else
           moveCount++;
 
-      if (RootNode)
+      if (RootNode && !helper)
       {
           Signals.firstRootMove = (moveCount == 1);
 
-          if (thisThread == Threads.main() && Time::now() - SearchTime > 3000)
+          if (thisThread == Threads.main() && Time::coarse_now() - SearchTime > 3000)
               sync_cout << "info depth " << depth / ONE_PLY
                         << " currmove " << move_to_uci(move, pos.is_chess960())
                         << " currmovenumber " << moveCount + PVIdx << sync_endl;
@@ -878,7 +1200,7 @@ moves_loop: // When in check and at SpNode search starts from here
               && (!threatMove || !refutes(pos, move, threatMove)))
           {
               if (SpNode)
-                  splitPoint->mutex.lock();
+                  thisThread->lock(splitPoint->mutex);
 
               continue;
           }
@@ -888,7 +1210,7 @@ moves_loop: // When in check and at SpNode search starts from here
           // but fixing this made program slightly weaker.
           Depth predictedDepth = newDepth - reduction<PvNode>(improving, depth, moveCount);
           futilityValue =  ss->staticEval + ss->evalMargin + futility_margin(predictedDepth, moveCount)
-                         + Gains[pos.piece_moved(move)][to_sq(move)];
+                         + stats.gains[pos.piece_moved(move)][to_sq(move)];
 
           if (futilityValue < beta)
           {
@@ -896,7 +1218,7 @@ moves_loop: // When in check and at SpNode search starts from here
 
               if (SpNode)
               {
-                  splitPoint->mutex.lock();
+                  thisThread->lock(splitPoint->mutex);
                   if (bestValue > splitPoint->bestValue)
                       splitPoint->bestValue = bestValue;
               }
@@ -908,7 +1230,7 @@ moves_loop: // When in check and at SpNode search starts from here
               && pos.see_sign(move) < 0)
           {
               if (SpNode)
-                  splitPoint->mutex.lock();
+                  thisThread->lock(splitPoint->mutex);
 
               continue;
           }
@@ -993,7 +1315,7 @@ moves_loop: // When in check and at SpNode search starts from here
       // Step 18. Check for new best move
       if (SpNode)
       {
-          splitPoint->mutex.lock();
+          thisThread->lock(splitPoint->mutex);
           bestValue = splitPoint->bestValue;
           alpha = splitPoint->alpha;
       }
@@ -1007,7 +1329,7 @@ moves_loop: // When in check and at SpNode search starts from here
 
       if (RootNode)
       {
-          RootMove& rm = *std::find(RootMoves.begin(), RootMoves.end(), move);
+          RootMove& rm = *std::find(rootMoves.begin(), rootMoves.end(), move);
 
           // PV move or new best move ?
           if (pvMove || value > alpha)
@@ -1018,7 +1340,7 @@ moves_loop: // When in check and at SpNode search starts from here
               // We record how often the best move has been changed in each
               // iteration. This information is used for time management: When
               // the best move changes frequently, we allocate some more time.
-              if (!pvMove)
+              if (!pvMove && !helper)
                   BestMoveChanges++;
           }
           else
@@ -1053,6 +1375,7 @@ moves_loop: // When in check and at SpNode search starts from here
       // Step 19. Check for splitting the search
       if (   !SpNode
           &&  depth >= Threads.minimumSplitDepth
+          && !Threads.lazySMP
           &&  Threads.available_slave(thisThread)
           &&  thisThread->splitPointsSize < MAX_SPLITPOINTS_PER_THREAD)
       {
@@ -1102,15 +1425,15 @@ moves_loop: // When in check and at SpNode search starts from here
         // Increase history value of the cut-off move and decrease all the other
         // played non-capture moves.
         Value bonus = Value(int(depth) * int(depth));
-        History.update(pos.piece_moved(bestMove), to_sq(bestMove), bonus);
+        stats.history.update(pos.piece_moved(bestMove), to_sq(bestMove), bonus);
         for (int i = 0; i < quietCount - 1; i++)
         {
             Move m = quietsSearched[i];
-            History.update(pos.piece_moved(m), to_sq(m), -bonus);
+            stats.history.update(pos.piece_moved(m), to_sq(m), -bonus);
         }
 
         if (is_ok((ss-1)->currentMove))
-            Countermoves.update(pos.piece_on(prevMoveSq), prevMoveSq, bestMove);
+            stats.countermoves.update(pos.piece_on(prevMoveSq), prevMoveSq, bestMove);
     }
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
@@ -1135,11 +1458,12 @@ moves_loop: // When in check and at SpNode search starts from here
     assert(depth <= DEPTH_ZERO);
 
     StateInfo st;
+    TTEntry ttEntry;
     const TTEntry* tte;
     Key posKey;
     Move ttMove, move, bestMove;
     Value bestValue, value, ttValue, futilityValue, futilityBase, oldAlpha;
-    bool givesCheck, evasionPrunable;
+    bool givesCheck, evasionPrunable, lazy = false;
     Depth ttDepth;
 
     // To flag BOUND_EXACT a node with eval above alpha and no available moves
@@ -1149,6 +1473,8 @@ moves_loop: // When in check and at SpNode search starts from here
     ss->currentMove = bestMove = MOVE_NONE;
     ss->ply = (ss-1)->ply + 1;
 
+    check_limits(pos.this_thread());
+
     // Check for an instant draw or maximum ply reached
     if (pos.is_draw() || ss->ply > MAX_PLY)
         return DrawValue[pos.side_to_move()];
@@ -1161,7 +1487,7 @@ moves_loop: // When in check and at SpNode search starts from here
 
     // Transposition table lookup
     posKey = pos.key();
-    tte = TT.probe(posKey);
+    tte = TT.probe(posKey, ttEntry);
     ttMove = tte ? tte->move() : MOVE_NONE;
     ttValue = tte ? value_from_tt(tte->value(),ss->ply) : VALUE_NONE;
 
@@ -1172,7 +1498,7 @@ moves_loop: // When in check and at SpNode search starts from here
             : ttValue >= beta ? (tte->bound() &  BOUND_LOWER)
                               : (tte->bound() &  BOUND_UPPER)))
     {
-        ss->currentMove = ttMove; // Can be MOVE_NONE
+        ss->currentMove = ttMove && pos.is_pseudo_legal(ttMove) ? ttMove : MOVE_NONE;
         return ttValue;
     }
 
@@ -1184,20 +1510,23 @@ moves_loop: // When in check and at SpNode search starts from here
     }
     else
     {
+        // Only the stand pat against the window matters, evaluation can be lazy
         if (tte)
         {
             // Never assume anything on values stored in TT
             if (  (ss->staticEval = bestValue = tte->eval_value()) == VALUE_NONE
                 ||(ss->evalMargin = tte->eval_margin()) == VALUE_NONE)
-                ss->staticEval = bestValue = evaluate(pos, ss->evalMargin);
+                ss->staticEval = bestValue = evaluate(pos, ss->evalMargin, alpha, beta, lazy);
         }
         else
-            ss->staticEval = bestValue = evaluate(pos, ss->evalMargin);
+            ss->staticEval = bestValue = evaluate(pos, ss->evalMargin, alpha, beta, lazy);
 
-        // Stand pat. Return immediately if static value is at least beta
+        // Stand pat. Return immediately if static value is at least beta. A lazy
+        // evaluation is valid only against this window, so it is never saved
+        // in TT, where search() would take it as a static evaluation.
         if (bestValue >= beta)
         {
-            if (!tte)
+            if (!tte && !lazy)
                 TT.store(pos.key(), value_to_tt(bestValue, ss->ply), BOUND_LOWER,
                          DEPTH_NONE, MOVE_NONE, ss->staticEval, ss->evalMargin);
 
@@ -1214,7 +1543,7 @@ moves_loop: // When in check and at SpNode search starts from here
     // to search the moves. Because the depth is <= 0 here, only captures,
     // queen promotions and checks (only if depth >= DEPTH_QS_CHECKS) will
     // be generated.
-    MovePicker mp(pos, ttMove, depth, History, to_sq((ss-1)->currentMove));
+    MovePicker mp(pos, ttMove, depth, to_sq((ss-1)->currentMove));
     CheckInfo ci(pos);
 
     // Loop through the moves until no moves remain or a beta cutoff occurs
@@ -1304,8 +1633,8 @@ moves_loop: // When in check and at SpNode search starts from here
               }
               else // Fail high
               {
-                  TT.store(posKey, value_to_tt(value, ss->ply), BOUND_LOWER,
-                           ttDepth, move, ss->staticEval, ss->evalMargin);
+                  TT.store(posKey, value_to_tt(value, ss->ply), BOUND_LOWER, ttDepth, move,
+                           lazy ? VALUE_NONE : ss->staticEval, lazy ? VALUE_NONE : ss->evalMargin);
 
                   return value;
               }
@@ -1319,8 +1648,8 @@ moves_loop: // When in check and at SpNode search starts from here
         return mated_in(ss->ply); // Plies to mate from the root
 
     TT.store(posKey, value_to_tt(bestValue, ss->ply),
-             PvNode && bestValue > oldAlpha ? BOUND_EXACT : BOUND_UPPER,
-             ttDepth, bestMove, ss->staticEval, ss->evalMargin);
+             PvNode && bestValue > oldAlpha ? BOUND_EXACT : BOUND_UPPER, ttDepth, bestMove,
+             lazy ? VALUE_NONE : ss->staticEval, lazy ? VALUE_NONE : ss->evalMargin);
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1552,8 +1881,8 @@ moves_loop: // When in check and at SpNode search starts from here
         s << "info depth " << d
           << " seldepth "  << selDepth
           << " score "     << (i == PVIdx ? score_to_uci(v, alpha, beta) : score_to_uci(v))
-          << " nodes "     << pos.nodes_searched()
-          << " nps "       << pos.nodes_searched() * 1000 / elapsed
+          << " nodes "     << nodes_searched()
+          << " nps "       << nodes_searched() * 1000 / elapsed
           << " time "      << elapsed
           << " multipv "   << i + 1
           << " pv";
@@ -1576,6 +1905,7 @@ moves_loop: // When in check and at SpNode search starts from here
 void RootMove::extract_pv_from_tt(Position& pos) {
 
   StateInfo state[MAX_PLY_PLUS_6], *st = state;
+  TTEntry ttEntry;
   const TTEntry* tte;
   int ply = 0;
   Move m = pv[0];
@@ -1588,7 +1918,7 @@ void RootMove::extract_pv_from_tt(Position& pos) {
       assert(MoveList<LEGAL>(pos).contains(pv[ply]));
 
       pos.do_move(pv[ply++], *st++);
-      tte = TT.probe(pos.key());
+      tte = TT.probe(pos.key(), ttEntry);
 
   } while (   tte
            && pos.is_pseudo_legal(m = tte->move()) // Local copy, TT could change
@@ -1609,11 +1939,12 @@ void RootMove::extract_pv_from_tt(Position& pos) {
 void RootMove::insert_pv_in_tt(Position& pos) {
 
   StateInfo state[MAX_PLY_PLUS_6], *st = state;
+  TTEntry ttEntry;
   const TTEntry* tte;
   int ply = 0;
 
   do {
-      tte = TT.probe(pos.key());
+      tte = TT.probe(pos.key(), ttEntry);
 
       if (!tte || tte->move() != pv[ply]) // Don't overwrite correct entries
           TT.store(pos.key(), VALUE_NONE, BOUND_NONE, DEPTH_NONE, pv[ply], VALUE_NONE, VALUE_NONE);
@@ -1640,6 +1971,22 @@ void Thread::idle_loop() {
 
   while (true)
   {
+      // Before going to sleep spin for "Idle Spin Time" usec, so that if we
+      // are booked soon we don't pay for a wakeup through the scheduler.
+      if (!searching && Threads.sleepWhileIdle && Threads.idleSpinTime)
+      {
+          int64_t end = Time::now_usec() + Threads.idleSpinTime;
+
+          for (int i = 1;    !searching && !exit
+                          && !(this_sp && this_sp->slavesMask.none()); i++)
+          {
+              cpu_pause();
+
+              if (!(i & 63) && Time::now_usec() > end)
+                  break;
+          }
+      }
+
       // If we are not searching, wait for a condition to be signaled instead of
       // wasting CPU time polling for work.
       while ((!searching && Threads.sleepWhileIdle) || exit)
@@ -1654,7 +2001,7 @@ void Thread::idle_loop() {
           mutex.lock();
 
           // If we are master and all slaves have finished then exit idle_loop
-          if (this_sp && !this_sp->slavesMask)
+          if (this_sp && this_sp->slavesMask.none())
           {
               mutex.unlock();
               break;
@@ -1670,18 +2017,53 @@ void Thread::idle_loop() {
           mutex.unlock();
       }
 
+      // Out of the search we may have been handed a task by ThreadPool::run()
+      if (searching && task)
+      {
+          task->run(this);
+
+          mutex.lock();
+          task = NULL;
+          searching = false;
+          Threads.sleepCondition.notify_one(); // Wake up UI thread
+          mutex.unlock();
+          continue;
+      }
+
+      // In Lazy SMP mode we have been woken up by the main thread to search the
+      // root position on our own, then we go back to idle and tell it.
+      if (searching && Threads.lazySMP && !activeSplitPoint)
+      {
+          helper_id_loop(rootPos);
+
+          searching = false;
+          Threads.main()->notify_one();
+          continue;
+      }
+
       // If this thread has been assigned work, launch a search
       if (searching)
       {
           assert(!exit);
 
-          Threads.mutex.lock();
+          // Pairs with the barrier in split(), that sets our split point before
+          // raising 'searching'.
+          memory_barrier();
 
           assert(searching);
           assert(activeSplitPoint);
           SplitPoint* sp = activeSplitPoint;
 
-          Threads.mutex.unlock();
+          if (this != sp->masterThread)
+          {
+              int64_t latency = Time::now_usec() - bookedTime;
+              int b = 0;
+
+              while (b < WAKEUP_BUCKETS - 1 && (1LL << b) <= latency)
+                  b++;
+
+              wakeups[b]++;
+          }
 
           Stack stack[MAX_PLY_PLUS_6], *ss = stack+2; // To allow referencing (ss-2)
           Position pos(*sp->pos, this);
@@ -1689,11 +2071,7 @@ void Thread::idle_loop() {
           std::memcpy(ss-2, sp->ss-2, 5 * sizeof(Stack));
           ss->splitPoint = sp;
 
-          sp->mutex.lock();
-
-          assert(activePosition == NULL);
-
-          activePosition = &pos;
+          lock(sp->mutex);
 
           switch (sp->nodeType) {
           case Root:
@@ -1712,15 +2090,13 @@ void Thread::idle_loop() {
           assert(searching);
 
           searching = false;
-          activePosition = NULL;
-          sp->slavesMask &= ~(1ULL << idx);
-          sp->nodes += pos.nodes_searched();
+          sp->slavesMask.reset(idx);
 
           // Wake up master thread so to allow it to return from the idle loop
           // in case we are the last slave of the split point.
           if (    Threads.sleepWhileIdle
               &&  this != sp->masterThread
-              && !sp->slavesMask)
+              &&  sp->slavesMask.none())
           {
               assert(!sp->masterThread->searching);
               sp->masterThread->notify_one();
@@ -1731,14 +2107,17 @@ void Thread::idle_loop() {
           // our feet by the sp master. Also accessing other Thread objects is
           // unsafe because if we are exiting there is a chance are already freed.
           sp->mutex.unlock();
+
+          booked = 0;
+          Threads.idleThreads.atomic_set(idx);
       }
 
       // If this thread is the master of a split point and all slaves have finished
       // their work at this split point, return from the idle loop.
-      if (this_sp && !this_sp->slavesMask)
+      if (this_sp && this_sp->slavesMask.none())
       {
           this_sp->mutex.lock();
-          bool finished = !this_sp->slavesMask; // Retest under lock protection
+          bool finished = this_sp->slavesMask.none(); // Retest under lock protection
           this_sp->mutex.unlock();
           if (finished)
               return;
@@ -1747,16 +2126,37 @@ void Thread::idle_loop() {
 }
 
 
+/// next_check_time() returns how many msec the timer thread can sleep before
+/// calling check_time() again: until the deadline or the optimum time, if it
+/// is due before, but at least once a second to print debug info. Once past the
+/// optimum time the search could stop as soon as it is still at the first root
+/// move, and this we poll.
+
+int next_check_time() {
+
+  Time::point elapsed = Time::now() - SearchTime;
+  int64_t next = DebugInfoInterval;
+
+  if (!Limits.ponder && TimeMgr.deadline())
+      next = std::min(next, TimeMgr.deadline() - elapsed);
+
+  if (!Limits.ponder && Limits.use_time_management())
+      next = std::min(next, elapsed < TimeMgr.available_time() ? TimeMgr.available_time() - elapsed
+                                                               : TimerResolution);
+  return int(std::max(next, int64_t(1)));
+}
+
+
 /// check_time() is called by the timer thread when the timer triggers. It is
 /// used to print debug info and, more important, to detect when we are out of
-/// available time and so stop the search.
+/// available time and so stop the search. Node limits are checked by the
+/// searching threads themselves, see check_limits().
 
 void check_time() {
 
   static Time::point lastInfoTime = Time::now();
-  int64_t nodes = 0; // Workaround silly 'uninitialized' gcc warning
 
-  if (Time::now() - lastInfoTime >= 1000)
+  if (Time::now() - lastInfoTime >= DebugInfoInterval)
   {
       lastInfoTime = Time::now();
       dbg_print();
@@ -1765,46 +2165,12 @@ void check_time() {
   if (Limits.ponder)
       return;
 
-  if (Limits.nodes)
-  {
-      Threads.mutex.lock();
-
-      nodes = RootPos.nodes_searched();
-
-      // Loop across all split points and sum accumulated SplitPoint nodes plus
-      // all the currently active positions nodes.
-      for (size_t i = 0; i < Threads.size(); i++)
-          for (int j = 0; j < Threads[i]->splitPointsSize; j++)
-          {
-              SplitPoint& sp = Threads[i]->splitPoints[j];
-
-              sp.mutex.lock();
-
-              nodes += sp.nodes;
-              Bitboard sm = sp.slavesMask;
-              while (sm)
-              {
-                  Position* pos = Threads[pop_lsb(&sm)]->activePosition;
-                  if (pos)
-                      nodes += pos->nodes_searched();
-              }
-
-              sp.mutex.unlock();
-          }
-
-      Threads.mutex.unlock();
-  }
-
   Time::point elapsed = Time::now() - SearchTime;
   bool stillAtFirstMove =    Signals.firstRootMove
                          && !Signals.failedLowAtRoot
                          &&  elapsed > TimeMgr.available_time();
 
-  bool noMoreTime =   elapsed > TimeMgr.maximum_time() - 2 * TimerResolution
-                   || stillAtFirstMove;
-
-  if (   (Limits.use_time_management() && noMoreTime)
-      || (Limits.movetime && elapsed >= Limits.movetime)
-      || (Limits.nodes && nodes >= Limits.nodes))
+  if (   (TimeMgr.deadline() && elapsed >= TimeMgr.deadline())
+      || (Limits.use_time_management() && stillAtFirstMove))
       Signals.stop = true;
 }
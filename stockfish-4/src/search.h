@@ -104,7 +104,9 @@ extern Time::point SearchTime;
 extern StateStackPtr SetupStates;
 
 extern void init();
-extern size_t perft(Position& pos, Depth depth);
+extern size_t perft(Position& pos, Depth depth, bool divide = false);
+extern int64_t nodes_searched();
+extern void new_game();
 extern void think();
 
 } // namespace Search
@@ -19,6 +19,7 @@
 
 #include <algorithm> // For std::count
 #include <cassert>
+#include <cstring>   // For std::memset
 
 #include "movegen.h"
 #include "search.h"
@@ -83,15 +84,24 @@ void ThreadBase::wait_for(volatile const bool& b) {
 Thread::Thread() /* : splitPoints() */ { // Value-initialization bug in MSVC
 
   searching = false;
-  maxPly = splitPointsSize = 0;
+  booked = 0;
+  bookedTime = 0;
+  maxPly = splitPointsSize = completedDepth = 0;
+  nodes = 0;
+  splits = failedBookings = lockWaits = lockWaitTime = 0;
+  std::memset(wakeups, 0, sizeof(wakeups));
+  stats = &ownStats;
   activeSplitPoint = NULL;
-  activePosition = NULL;
+  task = NULL;
   idx = Threads.size();
+  Threads.idleThreads.atomic_set(idx);
 }
 
 
-// TimerThread::idle_loop() is where the timer thread waits msec milliseconds
-// and then calls check_time(). If msec is 0 thread sleeps until is woken up.
+// TimerThread::idle_loop() is where the timer thread waits until the next time
+// limit of the search is due and then calls check_time(). If 'run' is false
+// thread sleeps until is woken up.
+extern int next_check_time();
 extern void check_time();
 
 void TimerThread::idle_loop() {
@@ -101,11 +111,11 @@ void TimerThread::idle_loop() {
       mutex.lock();
 
       if (!exit)
-          sleepCondition.wait_for(mutex, msec ? msec : INT_MAX);
+          sleepCondition.wait_for(mutex, run ? next_check_time() : INT_MAX);
 
       mutex.unlock();
 
-      if (msec)
+      if (run)
           check_time();
   }
 }
@@ -122,7 +132,7 @@ void MainThread::idle_loop() {
 
       thinking = false;
 
-      while (!thinking && !exit)
+      while (!thinking && !task && !exit)
       {
           Threads.sleepCondition.notify_one(); // Wake up UI thread if needed
           sleepCondition.wait(mutex);
@@ -133,6 +143,17 @@ void MainThread::idle_loop() {
       if (exit)
           return;
 
+      if (task)
+      {
+          task->run(this);
+
+          mutex.lock();
+          task = NULL;
+          Threads.sleepCondition.notify_one(); // Wake up UI thread
+          mutex.unlock();
+          continue;
+      }
+
       searching = true;
 
       Search::think();
@@ -166,7 +187,7 @@ bool Thread::cutoff_occurred() const {
 
 bool Thread::is_available_to(const Thread* master) const {
 
-  if (searching)
+  if (searching || booked)
       return false;
 
   // Make a local copy to be sure doesn't become zero under our feet while
@@ -175,17 +196,18 @@ bool Thread::is_available_to(const Thread* master) const {
 
   // No split points means that the thread is available as a slave for any
   // other thread otherwise apply the "helpful master" concept if possible.
-  return !size || (splitPoints[size - 1].slavesMask & (1ULL << master->idx));
+  return !size || splitPoints[size - 1].slavesMask.test(master->idx);
 }
 
 
 // init() is called at startup to create and launch requested threads, that will
 // go immediately to sleep due to 'sleepWhileIdle' set to true. We cannot use
 // a c'tor becuase Threads is a static object and we need a fully initialized
-// engine at this point due to allocation of Endgames in Thread c'tor.
+// engine at this point due to allocation of Endgames, shared by all threads.
 
 void ThreadPool::init() {
 
+  endgames = new Endgames();
   sleepWhileIdle = true;
   timer = new_thread<TimerThread>();
   push_back(new_thread<MainThread>());
@@ -201,19 +223,25 @@ void ThreadPool::exit() {
 
   for (iterator it = begin(); it != end(); ++it)
       delete_thread(*it);
+
+  delete endgames;
 }
 
 
 // read_uci_options() updates internal threads parameters from the corresponding
-// UCI options and creates/destroys threads to match the requested number. Thread
-// objects are dynamically allocated to avoid creating in advance all possible
-// threads, with included pawns and material tables, if only few are used.
+// UCI options, creates/destroys threads to match the requested number, sizes
+// their pawns and material tables and selects their own or the shared move
+// statistics. Thread objects are dynamically allocated to avoid creating in
+// advance all possible threads, with included pawns and material tables, if
+// only few are used.
 
 void ThreadPool::read_uci_options() {
 
   maxThreadsPerSplitPoint = Options["Max Threads per Split Point"];
   minimumSplitDepth       = Options["Min Split Depth"] * ONE_PLY;
   size_t requested        = Options["Threads"];
+  lazySMP                 = std::string(Options["SMP Mode"]) == "Lazy SMP";
+  idleSpinTime            = Options["Idle Spin Time"];
 
   assert(requested > 0);
 
@@ -229,20 +257,40 @@ void ThreadPool::read_uci_options() {
 
   while (size() > requested)
   {
+      idleThreads.atomic_reset(back()->idx);
       delete_thread(back());
       pop_back();
   }
+
+  for (iterator it = begin(); it != end(); ++it)
+  {
+      (*it)->pawnsTable.resize(Options["Pawn Hash KB"]);
+      (*it)->materialTable.resize(Options["Material Hash KB"]);
+      (*it)->evalTable.resize(Options["Eval Hash KB"]);
+      (*it)->stats = Options["Shared History"] ? &main()->ownStats : &(*it)->ownStats;
+  }
+
+  Pawns::resize_shared(Options["Shared Pawn Hash KB"]);
 }
 
 
-// slave_available() tries to find an idle thread which is available as a slave
-// for the thread 'master'.
+// available_slave() tries to find an idle thread which is available as a slave
+// for the thread 'master'. Only the threads in the idle set are checked.
 
 Thread* ThreadPool::available_slave(const Thread* master) const {
 
-  for (const_iterator it = begin(); it != end(); ++it)
-      if ((*it)->is_available_to(master))
-          return *it;
+  for (int w = 0; w < int(size() + 63) / 64; w++)
+  {
+      Bitboard b = idleThreads.word(w);
+
+      while (b)
+      {
+          Thread* th = (*this)[64 * w + pop_lsb(&b)];
+
+          if (th->is_available_to(master))
+              return th;
+      }
+  }
 
   return NULL;
 }
@@ -272,9 +320,12 @@ void Thread::split(Position& pos, const Stack* ss, Value alpha, Value beta, Valu
   // Pick the next available split point from the split point stack
   SplitPoint& sp = splitPoints[splitPointsSize];
 
+  splits++;
+
   sp.masterThread = this;
   sp.parentSplitPoint = activeSplitPoint;
-  sp.slavesMask = 1ULL << idx;
+  sp.slavesMask.clear();
+  sp.slavesMask.set(idx);
   sp.depth = depth;
   sp.bestValue = *bestValue;
   sp.bestMove = *bestMove;
@@ -286,28 +337,45 @@ void Thread::split(Position& pos, const Stack* ss, Value alpha, Value beta, Valu
   sp.movePicker = movePicker;
   sp.moveCount = moveCount;
   sp.pos = &pos;
-  sp.nodes = 0;
   sp.cutoff = false;
   sp.ss = ss;
 
   // Try to allocate available threads and ask them to start searching setting
-  // 'searching' flag. This must be done under lock protection to avoid concurrent
-  // allocation of the same slave by another master.
-  Threads.mutex.lock();
-  sp.mutex.lock();
+  // 'searching' flag. A slave is booked with a compare-and-swap on its 'booked'
+  // flag, so that concurrent masters cannot allocate the same slave without
+  // a global lock. We hold the split point lock, slaves will wait for it.
+  lock(sp.mutex);
 
   splitPointsSize++;
   activeSplitPoint = &sp;
-  activePosition = NULL;
 
   size_t slavesCnt = 1; // This thread is always included
   Thread* slave;
 
-  while (    (slave = Threads.available_slave(this)) != NULL
-         && ++slavesCnt <= Threads.maxThreadsPerSplitPoint && !Fake)
+  while (    slavesCnt < Threads.maxThreadsPerSplitPoint && !Fake
+         && (slave = Threads.available_slave(this)) != NULL)
   {
-      sp.slavesMask |= 1ULL << slave->idx;
+      if (!atomic_cas(slave->booked, 0, 1))
+      {
+          failedBookings++;
+          continue;
+      }
+
+      // A master is set to 'searching' before leaving its last split point,
+      // after that we could have seen it as available through the parent one.
+      if (slave->searching)
+      {
+          slave->booked = 0;
+          failedBookings++;
+          continue;
+      }
+
+      slavesCnt++;
+      sp.slavesMask.set(slave->idx);
       slave->activeSplitPoint = &sp;
+      Threads.idleThreads.atomic_reset(slave->idx);
+      slave->bookedTime = Time::now_usec();
+      memory_barrier(); // Split point must be visible before 'searching'
       slave->searching = true; // Slave leaves idle_loop()
       slave->notify_one(); // Could be sleeping
   }
@@ -319,32 +387,30 @@ void Thread::split(Position& pos, const Stack* ss, Value alpha, Value beta, Valu
   if (slavesCnt > 1 || Fake)
   {
       sp.mutex.unlock();
-      Threads.mutex.unlock();
 
       Thread::idle_loop(); // Force a call to base class idle_loop()
 
       // In helpful master concept a master can help only a sub-tree of its split
       // point, and because here is all finished is not possible master is booked.
       assert(!searching);
-      assert(!activePosition);
 
       // We have returned from the idle loop, which means that all threads are
-      // finished. Note that setting 'searching' and decreasing splitPointsSize is
-      // done under lock protection to avoid a race with Thread::is_available_to().
-      Threads.mutex.lock();
-      sp.mutex.lock();
+      // finished.
+      lock(sp.mutex);
   }
 
+  // Setting 'searching' before decreasing splitPointsSize, with a barrier in
+  // between, avoids a race with Thread::is_available_to(): a master that sees
+  // the parent split point, where it could be a slave, sees us searching too.
   searching = true;
+  Threads.idleThreads.atomic_reset(idx);
+  memory_barrier();
   splitPointsSize--;
   activeSplitPoint = sp.parentSplitPoint;
-  activePosition = &pos;
-  pos.set_nodes_searched(pos.nodes_searched() + sp.nodes);
   *bestMove = sp.bestMove;
   *bestValue = sp.bestValue;
 
   sp.mutex.unlock();
-  Threads.mutex.unlock();
 }
 
 // Explicit template instantiations
@@ -363,6 +429,43 @@ void ThreadPool::wait_for_think_finished() {
 }
 
 
+// run() hands a task to the first 'cnt' threads of the pool, waking them up
+// from their idle loop, and returns when all of them have run it. Must be
+// called from the UI thread when no search is running.
+
+void ThreadPool::run(ThreadTask& t, size_t cnt) {
+
+  assert(cnt <= size());
+
+  wait_for_think_finished();
+
+  for (size_t i = 0; i < cnt; i++)
+  {
+      Thread* th = at(i);
+
+      th->mutex.lock();
+      th->task = &t;
+      memory_barrier(); // Task must be visible before 'searching'
+
+      if (th != main())
+          th->searching = true; // Leaves idle_loop()
+
+      th->sleepCondition.notify_one();
+      th->mutex.unlock();
+  }
+
+  for (size_t i = 0; i < cnt; i++)
+  {
+      Thread* th = at(i);
+
+      th->mutex.lock();
+      while (th->task)
+          sleepCondition.wait(th->mutex);
+      th->mutex.unlock();
+  }
+}
+
+
 // start_thinking() wakes up the main thread sleeping in MainThread::idle_loop()
 // so to start a new search, then returns immediately.
 
@@ -377,6 +480,10 @@ void ThreadPool::start_thinking(const Position& pos, const LimitsType& limits,
 
   RootMoves.clear();
   RootPos = pos;
+
+  for (size_t i = 0; i < size(); i++)
+      at(i)->nodes = 0;
+
   Limits = limits;
   if (states.get()) // If we don't set a new position, preserve current state
   {
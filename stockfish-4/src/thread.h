@@ -22,20 +22,23 @@
 
 #include <vector>
 
+#include "evaluate.h"
 #include "material.h"
 #include "movepick.h"
 #include "pawns.h"
 #include "position.h"
 #include "search.h"
 
-const int MAX_THREADS = 64; // Because SplitPoint::slavesMask is a uint64_t
+const int MAX_THREADS = 512;
 const int MAX_SPLITPOINTS_PER_THREAD = 8;
+const int WAKEUP_BUCKETS = 16;
 
 struct Mutex {
   Mutex() { lock_init(l); }
  ~Mutex() { lock_destroy(l); }
 
   void lock() { lock_grab(l); }
+  bool try_lock() { return lock_try(l); }
   void unlock() { lock_release(l); }
 
 private:
@@ -56,6 +59,36 @@ private:
   WaitCondition c;
 };
 
+/// ThreadsMask is a set of threads, one bit for each thread index. It is used
+/// for the slaves of a split point, where bits are set only when the split point
+/// is created and then cleared by the slaves when they finish, so the master can
+/// test for none() without locking, one word at a time. It is also used for the
+/// idle threads of the pool, where bits are changed concurrently by the threads
+/// with atomic_set() and atomic_reset().
+
+struct ThreadsMask {
+
+  static const int Words = (MAX_THREADS + 63) / 64;
+
+  void clear() { for (int i = 0; i < Words; i++) w[i] = 0; }
+  void set(size_t idx) { w[idx / 64] |= 1ULL << (idx % 64); }
+  void reset(size_t idx) { w[idx / 64] &= ~(1ULL << (idx % 64)); }
+  void atomic_set(size_t idx) { atomic_or(w[idx / 64], 1ULL << (idx % 64)); }
+  void atomic_reset(size_t idx) { atomic_and(w[idx / 64], ~(1ULL << (idx % 64))); }
+  bool test(size_t idx) const { return w[idx / 64] & (1ULL << (idx % 64)); }
+  uint64_t word(int i) const { return w[i]; }
+
+  bool none() const {
+    for (int i = 0; i < Words; i++)
+        if (w[i])
+            return false;
+    return true;
+  }
+
+private:
+  volatile uint64_t w[Words];
+};
+
 struct Thread;
 
 struct SplitPoint {
@@ -76,8 +109,7 @@ struct SplitPoint {
 
   // Shared data
   Mutex mutex;
-  volatile uint64_t slavesMask;
-  volatile int64_t nodes;
+  ThreadsMask slavesMask;
   volatile Value alpha;
   volatile Value bestValue;
   volatile Move bestMove;
@@ -86,6 +118,18 @@ struct SplitPoint {
 };
 
 
+struct Thread;
+
+/// ThreadTask is some work out of the search, like counting perft nodes or
+/// clearing the hash table, that ThreadPool::run() hands to the threads of the
+/// pool. run() is called once by each of them.
+
+struct ThreadTask {
+  virtual ~ThreadTask() {}
+  virtual void run(Thread* th) = 0;
+};
+
+
 /// ThreadBase struct is the base of the hierarchy from where we derive all the
 /// specialized thread classes.
 
@@ -115,6 +159,7 @@ struct Thread : public ThreadBase {
   virtual void idle_loop();
   bool cutoff_occurred() const;
   bool is_available_to(const Thread* master) const;
+  void lock(Mutex& m);
 
   template <bool Fake>
   void split(Position& pos, const Search::Stack* ss, Value alpha, Value beta, Value* bestValue, Move* bestMove,
@@ -122,19 +167,52 @@ struct Thread : public ThreadBase {
 
   SplitPoint splitPoints[MAX_SPLITPOINTS_PER_THREAD];
   Material::Table materialTable;
-  Endgames endgames;
   Pawns::Table pawnsTable;
-  Position* activePosition;
+  Eval::Table evalTable;
+  MoveStats ownStats;
+  MoveStats* stats; // Points to ownStats or, if shared, to the main thread's ones
   size_t idx;
   int maxPly;
+  Position rootPos; // Lazy SMP helpers search their own copy of the root
+  std::vector<Search::RootMove> rootMoves;
+  volatile int completedDepth;
+  Value completedScore; // Best move score and PV of the last completed iteration
+  std::vector<Move> completedPv;
   SplitPoint* volatile activeSplitPoint;
+  ThreadTask* volatile task; // Set by ThreadPool::run() while the pool is idle
   volatile int splitPointsSize;
   volatile bool searching;
+  volatile long booked; // Set with a compare-and-swap by the master booking us
+  int64_t bookedTime;
+  uint64_t splits, failedBookings, lockWaits, lockWaitTime; // Time in usec
+  uint64_t wakeups[WAKEUP_BUCKETS]; // Booking to search start, log2 usec buckets
+
+  // Nodes searched by this thread, written only by itself and summed by anyone
+  // without locking. Kept on its own cache line to avoid false sharing.
+  char pad1[64];
+  volatile int64_t nodes;
+  char pad2[64];
 };
 
 
+/// Thread::lock() grabs a split point lock, accounting the time spent waiting
+/// for it, if any, to the contention counters of the thread.
+
+inline void Thread::lock(Mutex& m) {
+
+  if (m.try_lock())
+      return;
+
+  int64_t start = Time::now_usec();
+  m.lock();
+  lockWaits++;
+  lockWaitTime += Time::now_usec() - start;
+}
+
+
 /// MainThread and TimerThread are derived classes used to characterize the two
-/// special threads: the main one and the recurring timer.
+/// special threads: the main one and the timer, that sleeps until the next time
+/// limit is due.
 
 struct MainThread : public Thread {
   MainThread() : thinking(true) {} // Avoid a race with start_thinking()
@@ -143,9 +221,9 @@ struct MainThread : public Thread {
 };
 
 struct TimerThread : public ThreadBase {
-  TimerThread() : msec(0) {}
+  TimerThread() : run(false) {}
   virtual void idle_loop();
-  int msec;
+  volatile bool run;
 };
 
 
@@ -162,15 +240,20 @@ struct ThreadPool : public std::vector<Thread*> {
   void read_uci_options();
   Thread* available_slave(const Thread* master) const;
   void wait_for_think_finished();
+  void run(ThreadTask& task, size_t cnt);
   void start_thinking(const Position&, const Search::LimitsType&,
                       const std::vector<Move>&, Search::StateStackPtr&);
 
   bool sleepWhileIdle;
+  int idleSpinTime; // In usec, before going to sleep
+  bool lazySMP;
   Depth minimumSplitDepth;
   size_t maxThreadsPerSplitPoint;
   Mutex mutex;
   ConditionVariable sleepCondition;
+  ThreadsMask idleThreads; // A hint, availability is checked when booking
   TimerThread* timer;
+  Endgames* endgames; // Read-only, shared by all threads
 };
 
 extern ThreadPool Threads;
@@ -137,6 +137,23 @@ void TimeManager::init(const Search::LimitsType& limits, int currentPly, Color u
 
   // Make sure that maxSearchTime is not over absoluteMaxSearchTime
   optimumSearchTime = std::min(optimumSearchTime, maximumSearchTime);
+
+  // The hard deadline, in msec since the search started, at which the timer
+  // thread stops the search. It is zero when there is none.
+  stopTime =  limits.movetime           ? limits.movetime
+            : limits.use_time_management() ? maximumSearchTime : 0;
+}
+
+
+/// TimeManager::record_overshoot() adds to the statistics the msec by which a
+/// move has been played after the deadline, negative if it was played before.
+
+void TimeManager::record_overshoot(int64_t overshoot) {
+
+  stats.moves++;
+  stats.overshootSum += overshoot;
+  stats.maxOvershoot = std::max(stats.maxOvershoot, overshoot);
+  stats.maxUndershoot = std::max(stats.maxUndershoot, -overshoot);
 }
 
 
@@ -21,16 +21,28 @@
 #define TIMEMAN_H_INCLUDED
 
 /// The TimeManager class computes the optimal time to think depending on the
-/// maximum available time, the move game number and other parameters.
+/// maximum available time, the move game number and other parameters. It also
+/// keeps, since the start of the game, how late the moves have been played
+/// with respect to the deadline.
 
 class TimeManager {
 public:
+  struct Stats {
+    int64_t moves, overshootSum, maxOvershoot, maxUndershoot;
+  };
+
   void init(const Search::LimitsType& limits, int currentPly, Color us);
   void pv_instability(int curChanges, int prevChanges);
+  void record_overshoot(int64_t overshoot);
+  void clear_stats() { stats = Stats(); }
   int available_time() const { return optimumSearchTime + unstablePVExtraTime; }
   int maximum_time() const { return maximumSearchTime; }
+  int deadline() const { return stopTime; }
+  const Stats& overshoot_stats() const { return stats; }
 
 private:
+  Stats stats;
+  int stopTime;
   int optimumSearchTime;
   int maximumSearchTime;
   int unstablePVExtraTime;
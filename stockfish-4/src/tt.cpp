@@ -17,73 +17,633 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <climits>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <vector>
+
+#if defined(__linux__)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
 
 #include "bitboard.h"
+#include "thread.h"
 #include "tt.h"
+#include "ucioption.h"
 
 TranspositionTable TT; // Our global transposition table
 
+namespace {
+
+  // A saved table file starts with a FileHeader, padded to HeaderSize so that
+  // clusters are page aligned when the file is mmap'ed, followed by the raw
+  // clusters. Entry layout is recorded to refuse files of a different build.
+
+  const char FileMagic[8] = { 'S', 'F', 'H', 'A', 'S', 'H', '\0', '\0' };
+  const uint32_t FileVersion = 1;
+  const size_t HeaderSize = 4096;
+
+  struct FileHeader {
+    char magic[8];
+    uint32_t version, entrySize, clusterSize, clusterBytes, clusterCount;
+    uint8_t generation;
+  };
+
+  // ClearTask is run by the first 'cnt' threads of the pool, each one zeroing
+  // the slice of the table of its index. The last slice takes the remainder.
+
+  struct ClearTask : public ThreadTask {
+
+    void run(Thread* th) {
+      size_t size = th->idx < cnt - 1 ? slice : bytes - th->idx * slice;
+      std::memset(begin + th->idx * slice, 0, size);
+    }
+
+    char* begin;
+    size_t bytes, slice, cnt;
+  };
+
+  // free_memory() releases memory got from mmap() if 'size' is not zero, or
+  // from calloc() otherwise, and closes the memory file 'fd' of a shared one.
+
+  void free_memory(void* mem, size_t size, int fd) {
+
+#if defined(__linux__)
+    if (fd != -1)
+        close(fd);
+
+    if (size)
+        munmap(mem, size);
+    else
+#else
+    (void)fd;
+#endif
+        free(mem);
+  }
+
+#if defined(__linux__)
+
+  const size_t HugePageSize = 2 * 1024 * 1024;
+
+  // online_nodes() returns a bitmask of the NUMA nodes listed in sysfs as
+  // online, in the "0-3,5" format. Defaults to node 0 only.
+
+  unsigned long online_nodes() {
+
+    std::ifstream f("/sys/devices/system/node/online");
+    std::string list, range;
+    unsigned long mask = 0;
+
+    if (!(f >> list))
+        return 1;
+
+    std::istringstream ss(list);
+
+    while (std::getline(ss, range, ','))
+    {
+        int first = atoi(range.c_str()), last = first;
+        size_t dash = range.find('-');
+
+        if (dash != std::string::npos)
+            last = atoi(range.c_str() + dash + 1);
+
+        for (int n = first; n <= last && n < int(sizeof(mask) * 8); n++)
+            mask |= 1UL << n;
+    }
+
+    return mask ? mask : 1;
+  }
+
+
+  // numa_bind() sets the NUMA memory policy of a not yet touched memory range
+  // calling mbind() directly, so that we don't depend on libnuma. Policy is
+  // "none", "interleave" across all the online nodes or the number of the node
+  // where memory should be bound. Returns a description of the outcome.
+
+  std::string numa_bind(void* addr, size_t size, const std::string& policy) {
+
+    const int MpolBind = 2, MpolInterleave = 3;
+    unsigned long online = online_nodes(), mask;
+    int mode;
+
+    if (policy.empty() || policy == "none")
+        return "";
+
+    if (policy == "interleave")
+        mode = MpolInterleave, mask = online;
+    else
+    {
+        int node = atoi(policy.c_str());
+
+        if (   policy.find_first_not_of("0123456789") != std::string::npos
+            || node >= int(sizeof(mask) * 8)
+            || !(online & (1UL << node)))
+            return ", unknown NUMA policy '" + policy + "' ignored";
+
+        mode = MpolBind, mask = 1UL << node;
+    }
+
+#if defined(SYS_mbind)
+    // Kernel reads maxnode - 1 bits of the mask, hence the + 1
+    if (!syscall(SYS_mbind, addr, size, mode, &mask, sizeof(mask) * 8 + 1, 0))
+        return mode == MpolBind ? ", bound to NUMA node " + policy
+                                : std::string(", interleaved across NUMA nodes");
+#endif
+
+    return ", NUMA policy '" + policy + "' failed";
+  }
+
+#endif
+
+} // namespace
+
 
 /// TranspositionTable::set_size() sets the size of the transposition table,
-/// measured in megabytes. Transposition table consists of a power of 2 number
-/// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// measured in kilobytes. Transposition table consists of any number of
+/// clusters and each cluster consists of ClusterSize number of TTEntry.
+/// When the table is resized its entries are kept, rehashed into the new size,
+/// so that an analysis session does not restart from a cold table. How the
+/// memory was obtained is kept for allocation(), the caller decides whether to
+/// report it.
 
-void TranspositionTable::set_size(size_t mbSize) {
+void TranspositionTable::set_size(size_t kbSize) {
 
-  assert(msb((mbSize << 20) / sizeof(TTEntry)) < 32);
+  assert(((kbSize << 10) / ClusterBytes) >> 32 == 0);
 
-  uint32_t size = ClusterSize << msb((mbSize << 20) / sizeof(TTEntry[ClusterSize]));
+  uint32_t size = uint32_t(std::max((kbSize << 10) / ClusterBytes, size_t(1)));
+  uint32_t oldSize = mem ? clusterCount : 0;
+  bool lp = Options["Large Pages"];
+  std::string numa = Options["NUMA Policy"];
+  bool samePolicy = (lp == largePages && numa == numaPolicy && shared == mappedShared);
 
-  if (hashMask == size - ClusterSize)
+  if (oldSize == size && samePolicy)
       return;
 
-  hashMask = size - ClusterSize;
-  free(mem);
-  mem = calloc(size * sizeof(TTEntry) + CACHE_LINE_SIZE - 1, 1);
+  largePages = lp;
+  numaPolicy = numa;
+
+  std::ostringstream ss;
+  ss << ((size_t(size) * ClusterBytes) >> 10) << " KB ";
+
+  if (oldSize && samePolicy && resize_in_place(size))
+  {
+      allocationInfo = ss.str() + "resized in place";
+      return;
+  }
+
+  // Keep the old table until its entries have been moved to the new one
+  void* oldMem = mem;
+  size_t oldMemSize = memSize;
+  int oldFd = shared_fd();
+  char* oldTable = table;
+
+  std::string path = allocate(size_t(size) * ClusterBytes);
 
   if (!mem)
   {
-      std::cerr << "Failed to allocate " << mbSize
-                << "MB for transposition table." << std::endl;
+      std::cerr << "Failed to allocate " << kbSize
+                << "KB for transposition table." << std::endl;
       exit(EXIT_FAILURE);
   }
 
-  table = (TTEntry*)((uintptr_t(mem) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1));
+  clusterCount = size;
+  clear(); // First touch, from the threads of the pool when the table is big
+
+  if (oldSize)
+      rehash(oldTable, oldSize, table, size);
+
+  free_memory(oldMem, oldMemSize, oldFd);
+
+  allocationInfo = ss.str() + "allocated with " + path;
+}
+
+
+/// TranspositionTable::set_shared() moves the table to a shared mapping, or
+/// back to a private one, keeping its entries. The shared table lives in a
+/// memory file, inherited by the processes started meanwhile that attach() to
+/// it to read and write the same entries. Returns false if the mapping could
+/// not be done, as on platforms other than Linux.
+
+bool TranspositionTable::set_shared(bool b) {
+
+#if defined(__linux__)
+  shared = b;
+  set_size((size_t(clusterCount) * ClusterBytes) >> 10);
+  shared = mappedShared;
+#endif
+
+  return shared == b;
+}
+
+
+/// TranspositionTable::attach() replaces the table with the shared one of the
+/// process that passed us its memory file, see set_shared().
+
+bool TranspositionTable::attach(int fd) {
+
+#if defined(__linux__)
+  struct stat st;
+  void* p;
+
+  if (   fstat(fd, &st)
+      || size_t(st.st_size) < ClusterBytes
+      || (p = mmap(NULL, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+      return false;
+
+  free_mem();
+  mem = table = (char*)p;
+  memSize = size_t(st.st_size);
+  clusterCount = uint32_t(memSize / ClusterBytes);
+  sharedFd = fd;
+  shared = mappedShared = true;
+  return true;
+#else
+  (void)fd;
+  return false;
+#endif
+}
+
+
+/// TranspositionTable::allocate() gets the memory for a table of the given
+/// size in bytes, setting 'mem', 'memSize' and 'table'. On Linux the table
+/// is mmap'ed, trying first explicit huge pages, then transparent ones if
+/// "Large Pages" is set, and the "NUMA Policy" is applied before the pages
+/// are touched. A shared table is mapped from a memory file instead, sized
+/// exactly so that attach() can tell the number of clusters. Returns a
+/// description of the path taken, 'mem' is NULL if the allocation failed.
+
+std::string TranspositionTable::allocate(size_t bytes) {
+
+  std::string path = "normal pages";
+
+#if defined(__linux__)
+
+  fileMapped = mappedShared = false;
+
+#  if defined(SYS_memfd_create)
+  if (shared)
+  {
+      int fd = int(syscall(SYS_memfd_create, "stockfish-hash", 0));
+
+      if (   fd != -1
+          && !ftruncate(fd, off_t(bytes))
+          && (mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) != MAP_FAILED)
+      {
+          table = (char*)mem;
+          memSize = bytes;
+          sharedFd = fd;
+          mappedShared = true;
+          return "shared memory" + numa_bind(mem, memSize, numaPolicy);
+      }
+
+      if (fd != -1)
+          close(fd);
+  }
+#  endif
+
+  // Explicit huge pages must have been reserved by the administrator, for
+  // instance through /proc/sys/vm/nr_hugepages, so this usually fails.
+  memSize = (bytes + HugePageSize - 1) & ~(HugePageSize - 1);
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  mem = largePages ? mmap(NULL, memSize, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0)
+                   : MAP_FAILED;
+
+  if (mem != MAP_FAILED)
+  {
+      table = (char*)mem;
+      path = "explicit huge pages";
+  }
+  else
+  {
+      // Over-allocate to align the table to a huge page boundary, as required
+      // for the kernel to back it with transparent huge pages.
+      memSize = bytes + HugePageSize;
+      mem = mmap(NULL, memSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+      if (mem == MAP_FAILED)
+          mem = NULL, memSize = 0;
+      else
+      {
+          table = (char*)((uintptr_t(mem) + HugePageSize - 1) & ~(HugePageSize - 1));
+
+          // Advise and bind the whole mapping, splitting it in many VMAs
+          // would make mremap() fail when the table is resized.
+          if (largePages && !madvise(mem, memSize, MADV_HUGEPAGE))
+              path = "transparent huge pages";
+      }
+  }
+
+  if (mem)
+  {
+      path += numa_bind(mem, memSize, numaPolicy);
+      return path;
+  }
+
+#endif
+
+  fileMapped = mappedShared = false;
+  memSize = 0;
+  mem = calloc(bytes + CACHE_LINE_SIZE - 1, 1);
+  table = (char*)((uintptr_t(mem) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1));
+  return path;
+}
+
+
+/// TranspositionTable::resize_in_place() changes the size of an mmap'ed table
+/// without a second allocation. Shrinking merges the clusters and then gives
+/// back the tail of the mapping, growing extends the mapping with mremap()
+/// and then fills the new clusters. Returns false if the table could not be
+/// resized this way, in which case it is left untouched.
+
+bool TranspositionTable::resize_in_place(uint32_t size) {
+
+#if defined(__linux__)
+
+  if (!memSize || fileMapped || mappedShared)
+      return false;
+
+  uint32_t oldSize = clusterCount;
+  size_t offset = table - (char*)mem;
+  size_t newMemSize = offset + size_t(size) * ClusterBytes;
+
+  if (size < oldSize)
+  {
+      rehash(table, oldSize, table, size);
+      clusterCount = size;
+
+      // Should this fail, as with explicit huge pages, we just keep the memory
+      if (mremap(mem, memSize, newMemSize, 0) != MAP_FAILED)
+          memSize = newMemSize;
+
+      return true;
+  }
+
+  void* p = mremap(mem, memSize, newMemSize, MREMAP_MAYMOVE);
+
+  if (p == MAP_FAILED)
+      return false;
+
+  mem = p;
+  memSize = newMemSize;
+  table = (char*)mem + offset;
+
+  if (largePages)
+      madvise(mem, memSize, MADV_HUGEPAGE);
+
+  numa_bind(mem, memSize, numaPolicy);
+  rehash(table, oldSize, table, size);
+  clusterCount = size;
+  return true;
+
+#else
+  (void)size;
+  return false;
+#endif
+}
+
+
+/// TranspositionTable::rehash() moves the entries of a table of 'fromSize'
+/// clusters into one of 'toSize' clusters, that can overlap at the same address.
+/// With multiply-shift indexing each cluster covers a contiguous range of key
+/// values, so every new cluster is filled with the most valuable entries of
+/// the old clusters whose range overlaps its own. When growing an old cluster
+/// is copied in all the new ones it overlaps, the copies that don't belong
+/// there will simply never be hit. New clusters are filled going away from
+/// the start when shrinking and towards it when growing, so that in place
+/// an old cluster is never overwritten before all its readers are done.
+
+void TranspositionTable::rehash(char* from, uint32_t fromSize, char* to, uint32_t toSize) const {
+
+  TTEntry best[ClusterSize];
+  int worth[ClusterSize];
+  bool growing = toSize > fromSize;
+
+  for (uint32_t k = 0; k < toSize; k++)
+  {
+      uint32_t j = growing ? toSize - 1 - k : k;
+      uint32_t first = uint32_t(uint64_t(j) * fromSize / toSize);
+      uint32_t last  = uint32_t((uint64_t(j + 1) * fromSize - 1) / toSize);
+
+      for (unsigned n = 0; n < ClusterSize; n++)
+          worth[n] = INT_MIN;
+
+      for (uint32_t i = first; i <= last; i++)
+          for (const TTEntry* tte = cluster(from, i); tte < cluster(from, i) + ClusterSize; tte++)
+          {
+              if (!tte->key())
+                  continue;
+
+              int w = tte->depth() + (tte->generation() == generation ? 4 * MAX_PLY * ONE_PLY : 0);
+              unsigned worst = 0;
+
+              for (unsigned n = 1; n < ClusterSize; n++)
+                  if (worth[n] < worth[worst])
+                      worst = n;
+
+              if (w > worth[worst])
+                  best[worst] = *tte, worth[worst] = w;
+          }
+
+      for (unsigned n = 0; n < ClusterSize; n++)
+          if (worth[n] == INT_MIN)
+              std::memset(&best[n], 0, sizeof(TTEntry));
+
+      std::memcpy(cluster(to, j), best, sizeof(best));
+  }
+}
+
+
+/// TranspositionTable::free_mem() releases the table memory, unmapping it or
+/// freeing it according to how it has been allocated.
+
+void TranspositionTable::free_mem() {
+
+  free_memory(mem, memSize, shared_fd());
+  mem = NULL;
+  memSize = 0;
+  fileMapped = mappedShared = false;
+}
+
+
+/// TranspositionTable::save() writes the table to a file, with a header that
+/// records the table size, the current generation and the entry layout.
+
+bool TranspositionTable::save(const std::string& fileName) const {
+
+  // Build the header in the zeroed buffer, so that its padding is zero too
+  std::vector<char> header(HeaderSize, 0);
+  FileHeader* h = (FileHeader*)&header[0];
+
+  std::memcpy(h->magic, FileMagic, sizeof(FileMagic));
+  h->version = FileVersion;
+  h->entrySize = sizeof(TTEntry);
+  h->clusterSize = ClusterSize;
+  h->clusterBytes = ClusterBytes;
+  h->clusterCount = clusterCount;
+  h->generation = generation;
+
+  // The table may be a mapping of the very file we are saving to, so write a
+  // new file and move it over the old one, that stays alive while mapped.
+  std::string tmpName = fileName + ".tmp";
+  std::ofstream f(tmpName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+  f.write(&header[0], HeaderSize);
+  f.write(table, std::streamsize(size_t(clusterCount) * ClusterBytes));
+  f.close();
+
+  if (f.fail() || std::rename(tmpName.c_str(), fileName.c_str()))
+  {
+      std::remove(tmpName.c_str());
+      sync_cout << "info string Could not save hash to " << fileName << sync_endl;
+      return false;
+  }
+
+  sync_cout << "info string Hash saved to " << fileName << sync_endl;
+  return true;
+}
+
+
+/// TranspositionTable::load() reads back a table written by save(). When the
+/// saved table has the same number of clusters as the current one, on Linux
+/// the file is mmap'ed privately and used directly as the table, with no copy
+/// and pages read in on demand. Otherwise the saved entries are rehashed into
+/// the current table.
+
+bool TranspositionTable::load(const std::string& fileName) {
+
+  FileHeader h;
+  std::ifstream f(fileName.c_str(), std::ios::in | std::ios::binary);
+
+  if (   !f.read((char*)&h, sizeof(h))
+      || std::memcmp(h.magic, FileMagic, sizeof(FileMagic))
+      || h.version != FileVersion
+      || h.entrySize != sizeof(TTEntry)
+      || h.clusterSize != ClusterSize
+      || h.clusterBytes != ClusterBytes
+      || !h.clusterCount)
+  {
+      sync_cout << "info string " << fileName << " is not a hash file of this build" << sync_endl;
+      return false;
+  }
+
+  size_t bytes = size_t(h.clusterCount) * ClusterBytes;
+
+  if (!f.seekg(0, std::ios::end) || size_t(f.tellg()) != HeaderSize + bytes)
+  {
+      sync_cout << "info string " << fileName << " is truncated" << sync_endl;
+      return false;
+  }
+
+  generation = h.generation & TTEntry::GenerationMask;
+
+#if defined(__linux__)
+
+  int fd = h.clusterCount == clusterCount ? open(fileName.c_str(), O_RDONLY) : -1;
+
+  if (fd != -1)
+  {
+      void* p = mmap(NULL, HeaderSize + bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      close(fd);
+
+      if (p != MAP_FAILED)
+      {
+          free_mem();
+          mem = p;
+          memSize = HeaderSize + bytes;
+          table = (char*)p + HeaderSize;
+          fileMapped = true;
+          mappedShared = false;
+
+          std::ostringstream ss;
+          ss << ((size_t(clusterCount) * ClusterBytes) >> 10) << " KB mapped from " << fileName;
+          allocationInfo = ss.str();
+
+          sync_cout << "info string Hash mapped from " << fileName << sync_endl;
+          return true;
+      }
+  }
+
+#endif
+
+  std::vector<char> buf(bytes);
+
+  if (!f.seekg(HeaderSize) || !f.read(&buf[0], std::streamsize(bytes)))
+  {
+      sync_cout << "info string Could not read " << fileName << sync_endl;
+      return false;
+  }
+
+  rehash(&buf[0], h.clusterCount, table, clusterCount);
+
+  std::ostringstream ss;
+  ss << ((size_t(clusterCount) * ClusterBytes) >> 10) << " KB loaded from " << fileName;
+  allocationInfo = ss.str();
+
+  sync_cout << "info string Hash loaded from " << fileName << sync_endl;
+  return true;
 }
 
 
 /// TranspositionTable::clear() overwrites the entire transposition table
 /// with zeroes. It is called whenever the table is resized, or when the
-/// user asks the program to clear the table (from the UCI interface).
+/// user asks the program to clear the table (from the UCI interface). Big
+/// tables are split in one slice per thread of the pool, each zeroed by its
+/// own thread, so that they are cleared faster. Threads are not bound to a
+/// node, so where the pages end up is left to the OS. While a search is
+/// running the pool is busy and the table is cleared by the calling thread.
 
 void TranspositionTable::clear() {
 
-  std::memset(table, 0, (hashMask + ClusterSize) * sizeof(TTEntry));
+  const size_t MinSlice = 4 * 1024 * 1024;
+
+  ClearTask task;
+  task.begin = table;
+  task.bytes = size_t(clusterCount) * ClusterBytes;
+  task.cnt = std::max(size_t(1), std::min(Threads.size(), task.bytes / MinSlice));
+  task.slice = (task.bytes / task.cnt) & ~size_t(CACHE_LINE_SIZE - 1);
+
+  if (task.cnt == 1 || Threads.main()->thinking)
+      std::memset(table, 0, task.bytes);
+  else
+      Threads.run(task, task.cnt);
 }
 
 
 /// TranspositionTable::probe() looks up the current position in the
-/// transposition table. Returns a pointer to the TTEntry or NULL if
-/// position is not found.
+/// transposition table. On a hit the entry is copied into 'snapshot' and a
+/// pointer to it is returned, NULL if position is not found. Key verification
+/// is done on the copy, so the caller gets data that can't change under its
+/// feet even if another thread is concurrently writing the same entry.
 
-const TTEntry* TranspositionTable::probe(const Key key) const {
+const TTEntry* TranspositionTable::probe(const Key key, TTEntry& snapshot) const {
 
   const TTEntry* tte = first_entry(key);
-  uint32_t key32 = key >> 32;
+  uint32_t key32 = TTEntry::key_of(key);
 
   for (unsigned i = 0; i < ClusterSize; i++, tte++)
-      if (tte->key() == key32)
-          return tte;
+  {
+      snapshot = *tte;
+
+      if (snapshot.key() == key32)
+          return &snapshot;
+  }
 
   return NULL;
 }
 
 
 /// TranspositionTable::store() writes a new entry containing position key and
-/// valuable information of current position. The lowest order bits of position
-/// key are used to decide on which cluster the position will be placed.
+/// valuable information of current position. The lower 32 bits of position key,
+/// scaled to the number of clusters with a multiply-shift as in first_entry(),
+/// decide on which cluster the position will be placed.
 /// When a new entry is written and there are no empty entries available in cluster,
 /// it replaces the least valuable of entries. A TTEntry t1 is considered to be
 /// more valuable than a TTEntry t2 if t1 is from the current search and t2 is from
@@ -93,7 +653,7 @@ void TranspositionTable::store(const Key key, Value v, Bound b, Depth d, Move m,
 
   int c1, c2, c3;
   TTEntry *tte, *replace;
-  uint32_t key32 = key >> 32; // Use the high 32 bits as key inside the cluster
+  uint32_t key32 = TTEntry::key_of(key); // Use the high bits as key inside the cluster
 
   tte = replace = first_entry(key);
 
@@ -20,9 +20,13 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <string>
+
 #include "misc.h"
 #include "types.h"
 
+#if !defined(COMPACT_TT)
+
 /// The TTEntry is the 128 bit transposition table entry, defined as below:
 ///
 /// key: 32 bit
@@ -33,12 +37,22 @@
 /// depth: 16 bit
 /// static value: 16 bit
 /// static margin: 16 bit
+///
+/// Entries are read and written by all the search threads without any locking,
+/// so a thread could read an entry while another one is overwriting it and see
+/// the key of a position together with the data of a different one. To detect
+/// such torn entries the stored key is XOR-ed with the remaining three 32 bit
+/// words of the entry: a key matches only if the data it has been saved with
+/// is still there, otherwise the entry simply looks like a miss.
 
 struct TTEntry {
 
+  static const int GenerationMask = 0xFF;
+
+  static uint32_t key_of(Key k) { return uint32_t(k >> 32); }
+
   void save(uint32_t k, Value v, Bound b, Depth d, Move m, int g, Value ev, Value em) {
 
-    key32        = (uint32_t)k;
     move16       = (uint16_t)m;
     bound8       = (uint8_t)b;
     generation8  = (uint8_t)g;
@@ -46,10 +60,16 @@ struct TTEntry {
     depth16      = (int16_t)d;
     evalValue    = (int16_t)ev;
     evalMargin   = (int16_t)em;
+    key32        = (uint32_t)k ^ data_hash();
+  }
+  void set_generation(uint8_t g) {
+
+    uint32_t k = key();
+    generation8 = g;
+    key32 = k ^ data_hash();
   }
-  void set_generation(uint8_t g) { generation8 = g; }
 
-  uint32_t key() const      { return key32; }
+  uint32_t key() const      { return key32 ^ data_hash(); }
   Depth depth() const       { return (Depth)depth16; }
   Move move() const         { return (Move)move16; }
   Value value() const       { return (Value)value16; }
@@ -59,38 +79,138 @@ struct TTEntry {
   Value eval_margin() const { return (Value)evalMargin; }
 
 private:
+  uint32_t data_hash() const {
+
+    return  (uint32_t(move16) | uint32_t(bound8) << 16 | uint32_t(generation8) << 24)
+          ^ (uint32_t(uint16_t(value16))   | uint32_t(uint16_t(depth16))    << 16)
+          ^ (uint32_t(uint16_t(evalValue)) | uint32_t(uint16_t(evalMargin)) << 16);
+  }
+
   uint32_t key32;
   uint16_t move16;
   uint8_t bound8, generation8;
   int16_t value16, depth16, evalValue, evalMargin;
 };
 
+#else
+
+/// With COMPACT_TT the TTEntry is packed in 80 bits, as below:
+///
+/// key: 16 bit
+/// move: 16 bit
+/// value: 16 bit
+/// static value: 16 bit
+/// depth: 8 bit
+/// generation: 5 bit, margin is zero flag: 1 bit, bound type: 2 bit
+///
+/// Depth is stored as an offset from DEPTH_QS_RECAPTURES, with 0 reserved for
+/// DEPTH_NONE, and generation wraps around every 32 searches. There is no room
+/// for the static margin, so it is known only when it is zero, otherwise
+/// eval_margin() returns VALUE_NONE and the caller has to evaluate again. As
+/// with the full entry the stored key is XOR-ed with the data words to detect
+/// torn writes, but with 16 bits this is a bit less reliable.
+
+struct TTEntry {
+
+  static const int GenerationMask = 0x1F;
+
+  static uint32_t key_of(Key k) { return uint32_t(k >> 48); }
+
+  void save(uint32_t k, Value v, Bound b, Depth d, Move m, int g, Value ev, Value em) {
+
+    assert(d == DEPTH_NONE || (d >= DEPTH_QS_RECAPTURES && d < DEPTH_QS_RECAPTURES + 255));
+
+    move16    = (uint16_t)m;
+    value16   = (int16_t)v;
+    evalValue = (int16_t)ev;
+    depth8    = (uint8_t)(d == DEPTH_NONE ? 0 : d - DEPTH_QS_RECAPTURES + 1);
+    genBound8 = (uint8_t)((g & GenerationMask) << 3 | (em == VALUE_ZERO) << 2 | b);
+    key16     = (uint16_t)(k ^ data_hash());
+  }
+  void set_generation(uint8_t g) {
+
+    uint16_t k = key();
+    genBound8 = (uint8_t)((g & GenerationMask) << 3 | (genBound8 & 7));
+    key16 = (uint16_t)(k ^ data_hash());
+  }
+
+  uint16_t key() const      { return key16 ^ data_hash(); }
+  Depth depth() const       { return depth8 ? Depth(depth8 + DEPTH_QS_RECAPTURES - 1) : DEPTH_NONE; }
+  Move move() const         { return (Move)move16; }
+  Value value() const       { return (Value)value16; }
+  Bound bound() const       { return (Bound)(genBound8 & 3); }
+  int generation() const    { return (int)(genBound8 >> 3); }
+  Value eval_value() const  { return (Value)evalValue; }
+  Value eval_margin() const { return genBound8 & 4 ? VALUE_ZERO : VALUE_NONE; }
+
+private:
+  uint16_t data_hash() const {
+
+    return uint16_t(move16 ^ uint16_t(value16) ^ uint16_t(evalValue) ^ (depth8 | genBound8 << 8));
+  }
+
+  uint16_t key16;
+  uint16_t move16;
+  int16_t value16, evalValue;
+  uint8_t depth8, genBound8;
+};
+
+#endif
+
 
-/// A TranspositionTable consists of a power of 2 number of clusters and each
-/// cluster consists of ClusterSize number of TTEntry. Each non-empty entry
+/// A TranspositionTable consists of any number of clusters and each cluster
+/// consists of ClusterSize number of TTEntry. Each non-empty entry
 /// contains information of exactly one position. Size of a cluster shall not be
-/// bigger than a cache line size. In case it is less, it should be padded to
-/// guarantee always aligned accesses.
+/// bigger than a cache line size. In case it is less, clusters are laid out at
+/// ClusterBytes apart to guarantee always aligned accesses.
 
 class TranspositionTable {
 
-  static const unsigned ClusterSize = 4; // A cluster is 64 Bytes
+#if defined(COMPACT_TT) && defined(TT_CLUSTER_32)
+  static const unsigned ClusterSize = 3, ClusterBytes = 32; // 30 bytes used
+#elif defined(COMPACT_TT)
+  static const unsigned ClusterSize = 6, ClusterBytes = 64; // 60 bytes used
+#else
+  static const unsigned ClusterSize = 4, ClusterBytes = 64;
+#endif
 
 public:
- ~TranspositionTable() { free(mem); }
-  void new_search() { generation++; }
+ ~TranspositionTable() { free_mem(); }
+  void new_search() { generation = (generation + 1) & TTEntry::GenerationMask; }
 
-  const TTEntry* probe(const Key key) const;
+  const TTEntry* probe(const Key key, TTEntry& snapshot) const;
   TTEntry* first_entry(const Key key) const;
-  void refresh(const TTEntry* tte) const;
-  void set_size(size_t mbSize);
+  void refresh(const Key key) const;
+  void set_size(size_t kbSize);
+  bool set_shared(bool b);
+  int shared_fd() const { return mappedShared ? sharedFd : -1; }
+  bool attach(int fd);
+  const std::string& allocation() const { return allocationInfo; }
   void clear();
   void store(const Key key, Value v, Bound type, Depth d, Move m, Value statV, Value kingD);
+  bool save(const std::string& fileName) const;
+  bool load(const std::string& fileName);
 
 private:
-  uint32_t hashMask;
-  TTEntry* table;
+  TTEntry* cluster(char* base, uint32_t idx) const {
+    return (TTEntry*)(base + size_t(idx) * ClusterBytes);
+  }
+
+  std::string allocate(size_t bytes);
+  bool resize_in_place(uint32_t clusters);
+  void rehash(char* from, uint32_t fromClusters, char* to, uint32_t toClusters) const;
+  void free_mem();
+
+  uint32_t clusterCount;
+  char* table;
   void* mem;
+  size_t memSize; // Non-zero when mem has been mmap'ed
+  bool fileMapped; // Table is a private mapping of a saved file
+  bool largePages;
+  bool shared, mappedShared; // Requested and actual MAP_SHARED mapping
+  int sharedFd; // Memory file of a shared mapping, valid if mappedShared
+  std::string numaPolicy;
+  std::string allocationInfo; // Size and path of the last allocation
   uint8_t generation; // Size must be not bigger than TTEntry::generation8
 };
 
@@ -98,21 +218,39 @@ extern TranspositionTable TT;
 
 
 /// TranspositionTable::first_entry() returns a pointer to the first entry of
-/// a cluster given a position. The lowest order bits of the key are used to
-/// get the index of the cluster.
+/// a cluster given a position. The lower 32 bits of the key are scaled to the
+/// number of clusters with a multiply-shift, so that table size doesn't need
+/// to be a power of 2.
 
 inline TTEntry* TranspositionTable::first_entry(const Key key) const {
 
-  return table + ((uint32_t)key & hashMask);
+  return cluster(table, uint32_t((uint64_t(uint32_t(key)) * clusterCount) >> 32));
 }
 
 
 /// TranspositionTable::refresh() updates the 'generation' value of the TTEntry
-/// to avoid aging. Normally called after a TT hit.
+/// of the given position to avoid aging. Normally called after a TT hit. The
+/// entry is searched again because probe() hands out only a private copy. The
+/// generation is updated on a copy, that is written back whole only if its key
+/// matches: if another thread stores into the slot meanwhile, the words of the
+/// two writes mix up and the key does not verify, as for any torn entry.
+
+inline void TranspositionTable::refresh(const Key key) const {
 
-inline void TranspositionTable::refresh(const TTEntry* tte) const {
+  TTEntry* tte = first_entry(key);
+  uint32_t key32 = TTEntry::key_of(key);
 
-  const_cast<TTEntry*>(tte)->set_generation(generation);
+  for (unsigned i = 0; i < ClusterSize; i++, tte++)
+  {
+      TTEntry e = *tte;
+
+      if (e.key() == key32)
+      {
+          e.set_generation(generation);
+          *tte = e;
+          return;
+      }
+  }
 }
 
 #endif // #ifndef TT_H_INCLUDED
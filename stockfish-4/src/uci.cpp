@@ -27,11 +27,19 @@
 #include "position.h"
 #include "search.h"
 #include "thread.h"
+#include "tt.h"
 #include "ucioption.h"
 
 using namespace std;
 
 extern void benchmark(const Position& pos, istream& is);
+extern void tt_stress(istream& is);
+extern void tt_resize(istream& is);
+extern void startup_time(istream& is);
+extern void smp_scaling(istream& is);
+extern void analyse(istream& is);
+extern void eval_cost(istream& is);
+extern void setwise_attacks(istream& is);
 
 namespace {
 
@@ -79,14 +87,18 @@ void UCI::loop(const string& args) {
               Threads.main()->notify_one(); // Could be sleeping
           }
           else
+          {
               Search::Limits.ponder = false;
+              Threads.timer->notify_one(); // Time limits are now due
+          }
       }
       else if (token == "perft" && (is >> token)) // Read perft depth
       {
           stringstream ss;
+          string divide;
 
-          ss << Options["Hash"]    << " "
-             << Options["Threads"] << " " << token << " current perft";
+          ss << "current " << Options["Threads"] << " " << token << " current "
+             << (is >> divide && divide == "divide" ? "divide" : "perft");
 
           benchmark(pos, ss);
       }
@@ -100,19 +112,34 @@ void UCI::loop(const string& args) {
       else if (token == "uci")
           sync_cout << "id name " << engine_info(true)
                     << "\n"       << Options
-                    << "\nuciok"  << sync_endl;
+                    << "\nuciok"
+                    << "\ninfo string Hash " << TT.allocation() << sync_endl;
 
       else if (token == "eval")
       {
           Search::RootColor = pos.side_to_move(); // Ensure it is set
           sync_cout << Eval::trace(pos) << sync_endl;
       }
-      else if (token == "ucinewgame") { /* Avoid returning "Unknown command" */ }
+      else if (token == "ucinewgame") Search::new_game();
       else if (token == "go")         go(pos, is);
       else if (token == "position")   position(pos, is);
       else if (token == "setoption")  setoption(is);
       else if (token == "flip")       pos.flip();
       else if (token == "bench")      benchmark(pos, is);
+      else if (token == "ttstress")   tt_stress(is);
+      else if (token == "ttresize")   tt_resize(is);
+      else if (token == "startup")    startup_time(is);
+      else if (token == "smpscale")   smp_scaling(is);
+      else if (token == "analyse")    analyse(is);
+      else if (token == "evalcost")   eval_cost(is);
+      else if (token == "setwise")    setwise_attacks(is);
+      else if (token == "magics")
+      {
+          string fileName = "magics.h";
+          is >> fileName;
+          if (!Bitboards::write_magics(fileName))
+              sync_cout << "info string Could not write " << fileName << sync_endl;
+      }
       else if (token == "d")          sync_cout << pos.pretty() << sync_endl;
       else if (token == "isready")    sync_cout << "readyok" << sync_endl;
       else
@@ -179,7 +206,15 @@ namespace {
         value += string(" ", !value.empty()) + token;
 
     if (Options.count(name))
-        Options[name] = value;
+    {
+        const UCI::Option& o = Options[name] = value;
+
+        // Tell the GUI how the table memory has been obtained. Names are case
+        // insensitive, so compare the options found rather than the strings.
+        if (   &o == &Options["Hash"]        || &o == &Options["Hash KB"]
+            || &o == &Options["Large Pages"] || &o == &Options["NUMA Policy"])
+            sync_cout << "info string Hash " << TT.allocation() << sync_endl;
+    }
     else
         sync_cout << "No such option: " << name << sync_endl;
   }
@@ -38,8 +38,20 @@ namespace UCI {
 void on_logger(const Option& o) { start_logger(o); }
 void on_eval(const Option&) { Eval::init(); }
 void on_threads(const Option&) { Threads.read_uci_options(); }
-void on_hash_size(const Option& o) { TT.set_size(o); }
+void on_hash_size(const Option&) { TT.set_size(hash_kb()); }
 void on_clear_hash(const Option&) { TT.clear(); }
+void on_save_hash(const Option&) { TT.save(Options["Hash File"]); }
+void on_load_hash(const Option&) { TT.load(Options["Hash File"]); }
+
+
+/// hash_kb() returns the size in KB of the transposition table set by the
+/// options: "Hash KB" when not zero, that overrides "Hash" in MB.
+
+size_t hash_kb() {
+
+  int kb = Options["Hash KB"];
+  return kb ? size_t(kb) : size_t(Options["Hash"]) * 1024;
+}
 
 
 /// Our case insensitive less() function as required by UCI protocol
@@ -60,6 +72,7 @@ void init(OptionsMap& o) {
   o["Book File"]                   = Option("book.bin");
   o["Best Book Move"]              = Option(false);
   o["Contempt Factor"]             = Option(0, -50,  50);
+  o["Lazy Eval Margin"]            = Option(0, 0, 1000, on_eval);
   o["Mobility (Midgame)"]          = Option(100, 0, 200, on_eval);
   o["Mobility (Endgame)"]          = Option(100, 0, 200, on_eval);
   o["Pawn Structure (Midgame)"]    = Option(100, 0, 200, on_eval);
@@ -71,10 +84,23 @@ void init(OptionsMap& o) {
   o["Cowardice"]                   = Option(100, 0, 200, on_eval);
   o["Min Split Depth"]             = Option(0, 0, 12, on_threads);
   o["Max Threads per Split Point"] = Option(5, 4,  8, on_threads);
+  o["SMP Mode"]                    = Option("YBWC", on_threads);
+  o["Shared History"]              = Option(true, on_threads);
   o["Threads"]                     = Option(1, 1, MAX_THREADS, on_threads);
   o["Idle Threads Sleep"]          = Option(false);
+  o["Idle Spin Time"]              = Option(0, 0, 100000, on_threads);
   o["Hash"]                        = Option(32, 1, 8192, on_hash_size);
+  o["Hash KB"]                     = Option(0, 0, 8192 * 1024, on_hash_size);
+  o["Pawn Hash KB"]                = Option(16384 * sizeof(Pawns::Entry) / 1024, 1, 65536, on_threads);
+  o["Material Hash KB"]            = Option(8192 * sizeof(Material::Entry) / 1024, 1, 65536, on_threads);
+  o["Eval Hash KB"]                = Option(256, 1, 65536, on_threads);
+  o["Shared Pawn Hash KB"]         = Option(0, 0, 1024 * 1024, on_threads);
   o["Clear Hash"]                  = Option(on_clear_hash);
+  o["Hash File"]                   = Option("hash.bin");
+  o["Save Hash"]                   = Option(on_save_hash);
+  o["Load Hash"]                   = Option(on_load_hash);
+  o["Large Pages"]                 = Option(true, on_hash_size);
+  o["NUMA Policy"]                 = Option("none", on_hash_size);
   o["Ponder"]                      = Option(true);
   o["OwnBook"]                     = Option(false);
   o["MultiPV"]                     = Option(1, 1, 500);
@@ -113,6 +139,21 @@ std::ostream& operator<<(std::ostream& os, const OptionsMap& om) {
 }
 
 
+/// setoption_commands() returns the "setoption" commands, one per line, that
+/// give another engine the values of the options changed from their defaults.
+
+std::string setoption_commands(const OptionsMap& om) {
+
+  std::string cmds;
+
+  for (OptionsMap::const_iterator it = om.begin(); it != om.end(); ++it)
+      if (it->second.type != "button" && it->second.currentValue != it->second.defaultValue)
+          cmds += "setoption name " + it->first + " value " + it->second.currentValue + "\n";
+
+  return cmds;
+}
+
+
 /// Option c'tors and conversion operators
 
 Option::Option(const char* v, Fn* f) : type("string"), min(0), max(0), idx(Options.size()), on_change(f)
@@ -52,6 +52,7 @@ public:
 
 private:
   friend std::ostream& operator<<(std::ostream&, const OptionsMap&);
+  friend std::string setoption_commands(const OptionsMap&);
 
   std::string defaultValue, currentValue, type;
   int min, max;
@@ -61,6 +62,8 @@ private:
 
 void init(OptionsMap&);
 void loop(const std::string&);
+size_t hash_kb();
+std::string setoption_commands(const OptionsMap&);
 
 } // namespace UCI
 